@@ -2,28 +2,294 @@
 
 using namespace cgp;
 
+
+// Least-squares conjugate gradient with a diagonal preconditioner (same algorithm as Eigen::LeastSquaresConjugateGradient)
+//  Each column of x is an independent problem M x_c = rhs_c. The columns are iterated in lockstep:
+//  each iteration does a single sparse product by M and by M^T for all of them, a converged column being left unchanged.
+//  matrix_type is either a vector, or a row-major matrix with 3 columns: the coordinates of a vertex are contiguous,
+//  the sparse products read each coefficient of M once for the three columns, and the vector updates are single fused loops.
+template <typename matrix_type>
+static void least_squares_conjugate_gradient(Eigen::SparseMatrix<float> const& M, Eigen::VectorXf const& preconditioner, matrix_type const& rhs, matrix_type& x, int max_iterations, float tolerance)
+{
+    int const N = int(x.rows());
+    int const K = int(x.cols());
+    float const* const d = preconditioner.data();
+
+    matrix_type residual = rhs - M * x;
+    matrix_type normal_residual = M.transpose() * residual;
+    matrix_type const Mt_rhs = M.transpose() * rhs;
+    matrix_type p(N, K);
+    matrix_type Mp(int(M.rows()), K);
+
+    float threshold[3], abs_new[3], alpha[3], beta[3];
+    bool active[3];
+    bool any_active = false;
+    for (int c = 0; c < K; ++c) {
+        float const rhs_norm2 = Mt_rhs.col(c).squaredNorm();
+        abs_new[c] = 0.0f;
+
+        // Zero right-hand side: the solution is x = 0 (and the relative threshold would be 0)
+        if (rhs_norm2 == 0) {
+            x.col(c).setZero();
+            residual.col(c).setZero();
+            normal_residual.col(c).setZero();
+            threshold[c] = 0.0f;
+            active[c] = false;
+            continue;
+        }
+
+        threshold[c] = tolerance * tolerance * rhs_norm2;
+        active[c] = normal_residual.col(c).squaredNorm() > threshold[c];
+        any_active = any_active || active[c];
+    }
+    for (int i = 0; i < N; ++i)
+        for (int c = 0; c < K; ++c) {
+            p(i, c) = d[i] * normal_residual(i, c);
+            abs_new[c] += normal_residual(i, c) * p(i, c);
+        }
+
+    for (int k = 0; k < max_iterations && any_active; ++k) {
+        Mp.noalias() = M * p;
+        for (int c = 0; c < K; ++c) {
+            float const Mp_norm2 = Mp.col(c).squaredNorm();
+            active[c] = active[c] && Mp_norm2 > 0;
+            alpha[c] = active[c] ? abs_new[c] / Mp_norm2 : 0.0f;
+        }
+        for (int i = 0; i < N; ++i)
+            for (int c = 0; c < K; ++c)
+                x(i, c) += alpha[c] * p(i, c);
+        for (int i = 0; i < int(Mp.rows()); ++i)
+            for (int c = 0; c < K; ++c)
+                residual(i, c) -= alpha[c] * Mp(i, c);
+
+        normal_residual.noalias() = M.transpose() * residual;
+
+        // Preconditioned residual z = D r, and new direction p = z + beta p
+        float abs_next[3] = { 0,0,0 };
+        for (int i = 0; i < N; ++i)
+            for (int c = 0; c < K; ++c)
+                abs_next[c] += d[i] * normal_residual(i, c) * normal_residual(i, c);
+        any_active = false;
+        for (int c = 0; c < K; ++c) {
+            active[c] = active[c] && normal_residual.col(c).squaredNorm() > threshold[c] && abs_new[c] > 0;
+            any_active = any_active || active[c];
+            beta[c] = active[c] ? abs_next[c] / abs_new[c] : 0.0f;
+            abs_new[c] = abs_next[c];
+        }
+        for (int i = 0; i < N; ++i)
+            for (int c = 0; c < K; ++c)
+                p(i, c) = active[c] ? d[i] * normal_residual(i, c) + beta[c] * p(i, c) : 0.0f;
+    }
+}
+
+
+#ifndef USE_CHOLMOD
+bool sparse_cholesky_solver::update_diagonal(int k, double sigma)
+{
+    // Rank-1 modification of L D L^T by sigma w w^T (method C1 of Gill, Golub, Murray and Saunders), with w = P e_k.
+    //  The nonzeros of w, and of L^-1 w, stay on the path from P(k) to the root of the elimination tree.
+    w.resize(m_matrix.cols(), 0.0);
+
+    int j = m_P.size() > 0 ? int(m_P.indices()(k)) : k;
+    w[j] = 1.0;
+    double alpha = sigma;
+    bool positive = true;
+    while (j != -1) {
+        double const p = w[j];
+        w[j] = 0.0;
+
+        double const d = m_diag[j];
+        double const d_new = d + alpha * p * p;
+        positive = positive && d_new > 0;
+        double const beta = p * alpha / d_new;
+        alpha *= d / d_new;
+        m_diag[j] = d_new;
+
+        for (Eigen::SparseMatrix<double>::InnerIterator it(m_matrix, j); it; ++it) {
+            w[it.row()] -= p * it.value();
+            it.valueRef() += beta * w[it.row()];
+        }
+        j = m_parent[j];
+    }
+    return positive;
+}
+#endif
+
+
+// Fill M, its rhs (Laplacian rows) and the initial guess.
+//  weight2[k] is set to the sum of the squared weights of the constraint rows of the vertex k (0 if none): its contribution to the diagonal of M^T M.
+static void assemble_system(linear_system_structure& linear_system, constraint_structure const& constraints, mesh const& shape, numarray<vec3> const& initial_position, numarray<numarray<int> > const& one_ring, std::vector<float>& weight2)
+{
+    // The system M q = rhs is made of
+    //  - N rows of Laplacian coordinates: q_i - mean(q_j, j in one_ring(i)) = delta_i (computed on the initial shape)
+    //  - One row per constraint: w q_k = w p_k (the rhs of these rows is set in update_deformation)
+    int const N = int(initial_position.size());
+    int const N_constraint = int(constraints.fixed.size() + constraints.target.size());
+    int const N_row = N + N_constraint;
+
+    linear_system.rhs.resize(N_row, 3);
+
+    std::vector<Eigen::Triplet<float> > coefficients;
+    coefficients.reserve(N + N_constraint + 6 * N);
+    for (int i = 0; i < N; ++i) {
+        numarray<int> const& neighbors = one_ring[i];
+        int const N_neighbor = int(neighbors.size());
+
+        vec3 delta = initial_position[i];
+        coefficients.push_back({ i, i, 1.0f });
+        for (int j : neighbors) {
+            coefficients.push_back({ i, j, -1.0f / N_neighbor });
+            delta -= initial_position[j] / float(N_neighbor);
+        }
+
+        linear_system.rhs.row(i) << delta.x, delta.y, delta.z;
+    }
+
+    int row = N;
+    weight2.assign(N, 0.0f);
+    for (auto const& c : constraints.fixed) {
+        coefficients.push_back({ row++, c.first, constraints.weight_fixed });
+        weight2[c.first] += constraints.weight_fixed * constraints.weight_fixed;
+    }
+    for (auto const& c : constraints.target) {
+        coefficients.push_back({ row++, c.first, constraints.weight_target });
+        weight2[c.first] += constraints.weight_target * constraints.weight_target;
+    }
+
+    linear_system.M.resize(N_row, N);
+    linear_system.M.setFromTriplets(coefficients.begin(), coefficients.end());
+
+    // Initial guess of the iterative solver: the current shape
+    linear_system.guess.resize(N, 3);
+    for (int k = 0; k < N; ++k)
+        linear_system.guess.row(k) << shape.position[k].x, shape.position[k].y, shape.position[k].z;
+
+    if (linear_system.prefactorization)
+        linear_system.Mt = linear_system.M.cast<double>().transpose();
+}
+
+
+// Switch to the iterative solver: diagonal preconditioner of the normal equations
+static void initialize_iterative_solver(linear_system_structure& linear_system)
+{
+    int const N = int(linear_system.M.cols());
+    linear_system.prefactorization = false;
+    linear_system.factorized_weight2.clear();
+
+    linear_system.preconditioner.resize(N);
+    for (int j = 0; j < N; ++j) {
+        float const s = linear_system.M.col(j).squaredNorm();
+        linear_system.preconditioner[j] = s > 0 ? 1.0f / s : 1.0f;
+    }
+}
+
+// Check the last (numerical) factorization, and fall back to the iterative solver if it failed
+static bool check_factorization(linear_system_structure& linear_system)
+{
+    if (linear_system.factorization.info() == Eigen::Success)
+        return true;
+
+    std::cout << "\n **** Warning: the sparse Cholesky factorization of M^T M failed, the iterative solver is used instead ****" << std::endl;
+    initialize_iterative_solver(linear_system);
+    return false;
+}
+
+
 void build_matrix(linear_system_structure& linear_system, constraint_structure const& constraints, mesh const& shape, numarray<vec3> const& initial_position, numarray<numarray<int> > const& one_ring)
 {
-    // TO DO: Build and fill the matrix M and the rhs (M q_x/y/z = rhs_x/y/z)
-    //
-    //  linear_system.rhs_x.resize(...)
-    //  for all vertices
-    //      linear_system.rhs_x[k] = ....
-    //  
-    //  Fill the matrix:
-    //  linear_system.M.resize(...), linear_system.M.reserve(...)
-    //  for all non-zero elements:
-    //      linear_system.M.coeffRef(i,j) = ...
-    // 
+    std::vector<float> weight2;
+    assemble_system(linear_system, constraints, shape, initial_position, one_ring, weight2);
+
+    if (linear_system.prefactorization) {
+        Eigen::SparseMatrix<double> const MtM = linear_system.Mt * linear_system.Mt.transpose();
+        linear_system.factorization.compute(MtM);
+        if (check_factorization(linear_system))
+            linear_system.factorized_weight2 = weight2;
+    }
+    else
+        initialize_iterative_solver(linear_system);
+}
+
+
+void update_constraints(linear_system_structure& linear_system, constraint_structure const& constraints, mesh const& shape, numarray<vec3> const& initial_position, numarray<numarray<int> > const& one_ring)
+{
+    // Without factorization, there is nothing to reuse
+    int const N = int(initial_position.size());
+    if (!linear_system.prefactorization || int(linear_system.factorized_weight2.size()) != N) {
+        build_matrix(linear_system, constraints, shape, initial_position, one_ring);
+        return;
+    }
+
+    // M (and the rhs) are rebuilt: this is linear in the size of the mesh
+    std::vector<float> weight2;
+    assemble_system(linear_system, constraints, shape, initial_position, one_ring, weight2);
+
+    std::vector<int> modified;
+    for (int k = 0; k < N; ++k)
+        if (weight2[k] != linear_system.factorized_weight2[k])
+            modified.push_back(k);
+
+    // M^T M changed by sum_k (w_k^2 - w_k'^2) e_k e_k^T (w_k^2 summed over the constraint rows of the vertex k)
+    bool updated = false;
+#ifndef USE_CHOLMOD
+    if (modified.size() <= linear_system.max_update_ratio * N) {
+        updated = true;
+        for (int k : modified)
+            updated = updated && linear_system.factorization.update_diagonal(k, double(weight2[k]) - double(linear_system.factorized_weight2[k]));
+    }
+#endif
+
+    // Otherwise factorize again: the sparsity pattern of M^T M doesn't depend on the constraints (the Laplacian rows already fill its diagonal),
+    //  so that the symbolic analysis (ordering, elimination tree) is kept.
+    if (!updated) {
+        Eigen::SparseMatrix<double> const MtM = linear_system.Mt * linear_system.Mt.transpose();
+        linear_system.factorization.factorize(MtM);
+        if (!check_factorization(linear_system))
+            return;
+    }
+    linear_system.factorized_weight2 = weight2;
 }
 
 
 void update_deformation(linear_system_structure& linear_system, constraint_structure const& constraints, cgp::mesh& shape, cgp::mesh_drawable& visual, cgp::numarray<cgp::vec3> const& initial_position, cgp::numarray<cgp::numarray<int> > const& one_ring)
 {
-    // TO DO: Update the RHS with new constraints and Solve the system
-    //
-    // For all vertex and contraints
-    //   linear_system.rhs_x[k] = ... (+ rhs_y, rhs_z)
-    // 
-    // linear_system.solver.solve(linear_system.rhs_x) ... or linear_system.solver.solveWithGuess(linear_system.rhs_x, linear_system.guess_x), etc.
+    int const N = int(initial_position.size());
+
+    // Update the rhs of the constraints (same order as in build_matrix)
+    int row = N;
+    for (auto const& c : constraints.fixed)
+        linear_system.rhs.row(row++) << constraints.weight_fixed * c.second.x, constraints.weight_fixed * c.second.y, constraints.weight_fixed * c.second.z;
+    for (auto const& c : constraints.target)
+        linear_system.rhs.row(row++) << constraints.weight_target * c.second.x, constraints.weight_target * c.second.y, constraints.weight_target * c.second.z;
+
+    // Solve the system
+    if (linear_system.prefactorization) {
+        Eigen::MatrixXd const b = linear_system.Mt * linear_system.rhs.cast<double>(); // N x 3
+        linear_system.guess = linear_system.factorization.solve(b).cast<float>();
+    }
+    else {
+        int const max_iterations = linear_system.max_iterations > 0 ? linear_system.max_iterations : 2 * N;
+        if (linear_system.parallel_coordinates) {
+            #pragma omp parallel for schedule(static)
+            for (int c = 0; c < 3; ++c) {
+                Eigen::Matrix<float, Eigen::Dynamic, 1> const b = linear_system.rhs.col(c);
+                Eigen::Matrix<float, Eigen::Dynamic, 1> x = linear_system.guess.col(c);
+                least_squares_conjugate_gradient(linear_system.M, linear_system.preconditioner, b, x, max_iterations, linear_system.tolerance);
+                linear_system.guess.col(c) = x;
+            }
+        }
+        else {
+            Eigen::Matrix<float, Eigen::Dynamic, 3, Eigen::RowMajor> const b = linear_system.rhs;
+            Eigen::Matrix<float, Eigen::Dynamic, 3, Eigen::RowMajor> x = linear_system.guess;
+            least_squares_conjugate_gradient(linear_system.M, linear_system.preconditioner, b, x, max_iterations, linear_system.tolerance);
+            linear_system.guess = x;
+        }
+    }
+
+    // Update the shape and its display
+    for (int k = 0; k < N; ++k)
+        shape.position[k] = { linear_system.guess(k, 0), linear_system.guess(k, 1), linear_system.guess(k, 2) };
+    shape.normal_update();
+    visual.vbo_position.update(shape.position);
+    visual.vbo_normal.update(shape.normal);
 }
@@ -10,6 +10,24 @@
 #include "../third_party/eigen/Eigen/Sparse"
 #include "../third_party/eigen/Eigen/SVD"
 
+// Sparse Cholesky factorization used by the direct solver
+//  Eigen's own SimplicialLDLT by default, CHOLMOD (SuiteSparse) if USE_CHOLMOD is defined (see CMakeLists.txt)
+#ifdef USE_CHOLMOD
+#include "../third_party/eigen/Eigen/CholmodSupport"
+using sparse_cholesky_solver = Eigen::CholmodSupernodalLLT< Eigen::SparseMatrix<double> >;
+#else
+struct sparse_cholesky_solver : Eigen::SimplicialLDLT< Eigen::SparseMatrix<double> >
+{
+    // Update in place the factorization of A into the one of A + sigma e_k e_k^T (downdate if sigma < 0)
+    //  Only the columns of L on the path from k to the root of the elimination tree are modified.
+    //  Return false if the updated matrix is not positive definite (the factorization must then be computed again).
+    bool update_diagonal(int k, double sigma);
+
+private:
+    std::vector<double> w; // Work vector (zero between two calls)
+};
+#endif
+
 
 // 2 types of constraints:
 //  - Fixed points (associated to weight_target)
@@ -30,14 +48,44 @@ struct constraint_structure {
 struct linear_system_structure
 {
     Eigen::SparseMatrix<float> M; // The coefficients are stored in a Sparse Matrix
-    Eigen::LeastSquaresConjugateGradient< Eigen::SparseMatrix<float> > solver;  // Conjugate gradient solver
 
-    Eigen::VectorXf rhs_x, rhs_y, rhs_z;       // System Right-hand-Side
-    Eigen::VectorXf guess_x, guess_y, guess_z; // Initial coordinates used as initial guess solution
+    // The three coordinates are solved at once: the rhs and the solution are N x 3 dense matrices,
+    //  so that every product by M (or M^T) and every triangular solve is done once for the three columns.
+
+    // Iterative solver: least-squares conjugate gradient (CGLS) with the diagonal preconditioner, initialized with the previous solution
+    //  - parallel_coordinates: each coordinate is solved on its own thread, and stops as soon as it converged.
+    //  - otherwise the three columns are iterated together and share the sparse matrix products (cheaper per iteration,
+    //    but all the columns run until the slowest one converged: usually slower when a drag mostly moves one coordinate).
+    bool parallel_coordinates = true;
+    int max_iterations = 0;     // Maximal number of iterations (0: twice the number of vertices)
+    float tolerance = 1e-6f;    // Relative tolerance on the residual of the normal equations
+    Eigen::VectorXf preconditioner; // Inverse of the squared norm of the columns of M
+
+    // Direct solver: the normal equations M^T M q = M^T rhs are factorized once in build_matrix
+    //  As long as the set of constraints doesn't change, M is constant: moving the targets only updates the rhs,
+    //  and each solve costs a product by M^T and two sparse triangular solves.
+    //  The factorization is computed in double precision, as the condition number of M^T M is the square of the one of M.
+    bool prefactorization = true;
+    Eigen::SparseMatrix<double> Mt;       // Transpose of M
+    sparse_cholesky_solver factorization; // Factorization of M^T M
+
+    // A constraint row w q_k = w p_k only adds w^2 to the k-th diagonal coefficient of M^T M:
+    //  when the constraints change, update_constraints modifies the factorization by one rank-1 update/downdate per vertex
+    //  whose weight changed, instead of factorizing M^T M again.
+    //  If the factorization fails, the iterative solver is used instead (prefactorization is set to false).
+    std::vector<float> factorized_weight2; // Sum of the squared constraint weights of each vertex in the factorization (a vertex can be both fixed and target, empty: not factorized)
+    float max_update_ratio = 0.01f;       // Above this ratio of modified vertices, the matrix is factorized again (keeping its symbolic analysis)
+
+    Eigen::Matrix<float, Eigen::Dynamic, 3> rhs;   // System Right-hand-Side (one column per coordinate)
+    Eigen::Matrix<float, Eigen::Dynamic, 3> guess; // Current coordinates, used as initial guess solution
 
 };
 
 
 void build_matrix(linear_system_structure& linear_system, constraint_structure const& constraints, cgp::mesh const& shape, cgp::numarray<cgp::vec3> const& initial_position, cgp::numarray<cgp::numarray<int> > const& one_ring);
 
+// Update the system after a change of the constraints (vertices added/removed from the fixed or target sets, or new weights)
+//  Equivalent to build_matrix, but reuses the current factorization.
+void update_constraints(linear_system_structure& linear_system, constraint_structure const& constraints, cgp::mesh const& shape, cgp::numarray<cgp::vec3> const& initial_position, cgp::numarray<cgp::numarray<int> > const& one_ring);
+
 void update_deformation(linear_system_structure& linear_system, constraint_structure const& constraints, cgp::mesh& shape, cgp::mesh_drawable& visual, cgp::numarray<cgp::vec3> const& initial_position, cgp::numarray<cgp::numarray<int> > const& one_ring);
@@ -136,9 +136,15 @@ void scene_structure::display_gui()
 	bool change_active_weight = ImGui::SliderFloat("Weight Fixed", &constraints.weight_fixed, 0.05f, 10.0f, "%.3f", 3);
 	bool change_passive_weight = ImGui::SliderFloat("Weight Target", &constraints.weight_target, 0.05f, 10.0f, "%.3f", 3);
 	ImGui::Checkbox("Select constraint", &constraint_selection.selection_mode);
-
-	if (change_active_weight || change_passive_weight) {
-		build_matrix(linear_system, constraints, shape, initial_position, one_ring);
+	bool change_solver = ImGui::Checkbox("Prefactorization (sparse Cholesky)", &linear_system.prefactorization);
+	if (!linear_system.prefactorization)
+		ImGui::Checkbox("Parallel coordinates", &linear_system.parallel_coordinates);
+
+	if (change_active_weight || change_passive_weight || change_solver) {
+		if (change_solver)
+			build_matrix(linear_system, constraints, shape, initial_position, one_ring);
+		else
+			update_constraints(linear_system, constraints, shape, initial_position, one_ring);
 		surface_need_update = false;
 		update_deformation(linear_system, constraints, shape, visual, initial_position, one_ring);
 	}
@@ -239,9 +245,9 @@ void scene_structure::mouse_click_event()
 		}
 	}
 
-	// If mouse click/released in selection mode: rebuild the matrix
+	// If mouse click/released in selection mode: update the matrix and its factorization
 	if (inputs.keyboard.shift && constraint_selection.selection_mode) {
-		build_matrix(linear_system, constraints, shape, initial_position, one_ring);
+		update_constraints(linear_system, constraints, shape, initial_position, one_ring);
 		surface_need_update = false;
 		update_deformation(linear_system, constraints, shape, visual, initial_position, one_ring);
 		constraint_selection.temporary_idx.clear();
@@ -15,6 +15,7 @@ void scene_structure::initialize()
 
 
 	timer.event_period = 0.5f;
+	particles.initialize(gui.capacity);
 
 	// Edges of the containing cube
 	//  Note: this data structure is set for display purpose - don't use it to compute some information on the cube - it would be un-necessarily complex
@@ -38,12 +39,13 @@ void scene_structure::display_frame()
 
 	timer.update();
 
-	// Create a new particle if needed
+	// Create a new particle if needed, and remove the retired ones
 	emit_particle();
+	particles.retire(timer.t);
 
 	// Call the simulation of the particle system
 	float const dt = 0.01f * timer.scale;
-	simulate(particles, dt);
+	simulate(particles.particles, particles.alive, dt, solver);
 
 	// Display the result
 	sphere_display();
@@ -56,13 +58,15 @@ void scene_structure::display_frame()
 void scene_structure::sphere_display()
 {
 	// Display the particles as spheres
-	size_t const N = particles.size();
-	for (size_t k = 0; k < N; ++k)
+	particle_arrays_structure const& P = particles.particles;
+	int const N = P.size();
+	for (int k = 0; k < N; ++k)
 	{
-		particle_structure const& particle = particles[k];
-		sphere.material.color = particle.c;
-		sphere.model.translation = particle.p;
-		sphere.model.scaling = particle.r;
+		if (!particles.alive[k])
+			continue;
+		sphere.material.color = P.c[k];
+		sphere.model.translation = P.position(k);
+		sphere.model.scaling = P.r[k];
 
 		draw(sphere, environment);
 	}
@@ -81,12 +85,34 @@ void scene_structure::emit_particle()
 
 		particle_structure particle;
 		particle.p = { 0,0,0 };
-		particle.r = 0.08f;
+		particle.r = gui.radius;
 		particle.c = color_lut[int(rand_uniform() * color_lut.size())];
 		particle.v = v;
 		particle.m = 1.0f; 
 
-		particles.push_back(particle);
+		particles.emit(particle, timer.t);
+	}
+}
+
+void scene_structure::fill_pool()
+{
+	// Spheres at the nodes of a grid filling the box from the bottom, with a small random velocity
+	//  (stops when the pool or the box is full)
+	static numarray<vec3> const color_lut = { {1,0,0},{0,1,0},{0,0,1},{1,1,0},{1,0,1},{0,1,1} };
+	float const spacing = 2.2f * gui.radius;
+	int const n = int((2 - 2 * gui.radius) / spacing) + 1; // Number of spheres along each axis of the box [-1,1]^3
+	for (int kz = 0; kz < n && particles.size() < particles.capacity(); ++kz) {
+		for (int ky = 0; ky < n && particles.size() < particles.capacity(); ++ky) {
+			for (int kx = 0; kx < n && particles.size() < particles.capacity(); ++kx) {
+				particle_structure particle;
+				particle.p = vec3(-1 + gui.radius, -1 + gui.radius, -1 + gui.radius) + spacing * vec3(kx, ky, kz);
+				particle.v = { rand_uniform(-0.5f, 0.5f), rand_uniform(-0.5f, 0.5f), rand_uniform(-0.5f, 0.5f) };
+				particle.r = gui.radius;
+				particle.c = color_lut[int(rand_uniform() * color_lut.size())];
+				particle.m = 1.0f;
+				particles.emit(particle, timer.t);
+			}
+		}
 	}
 }
 
@@ -97,6 +123,19 @@ void scene_structure::display_gui()
 	ImGui::SliderFloat("Time scale", &timer.scale, 0.05f, 2.0f, "%.2f s");
 	ImGui::SliderFloat("Time to add new sphere", &timer.event_period, 0.05f, 2.0f, "%.2f s");
 	ImGui::Checkbox("Add sphere", &gui.add_sphere);
+
+	ImGui::Text("Spheres: %d / %d", particles.size(), particles.capacity());
+	// The pool is reallocated (and emptied) when the slider is released, not at each step of the drag
+	ImGui::SliderInt("Capacity (reset)", &gui.capacity, 100, 100000);
+	if (ImGui::IsItemDeactivatedAfterEdit())
+		particles.initialize(gui.capacity);
+	ImGui::SliderFloat("Radius of new spheres", &gui.radius, 0.01f, 0.2f, "%.3f");
+	if (ImGui::Button("Fill the pool"))
+		fill_pool();
+	ImGui::Checkbox("Recycle oldest", &particles.recycle_oldest);
+	ImGui::Checkbox("Retire by age", &particles.retire_by_age);
+	if (particles.retire_by_age)
+		ImGui::SliderFloat("Max age", &particles.max_age, 1.0f, 60.0f, "%.1f s");
 }
 
 void scene_structure::mouse_move_event()
@@ -5,6 +5,8 @@
 #include "environment.hpp"
 
 #include "simulation/simulation.hpp"
+#include "simulation/particle_pool.hpp"
+#include "simulation/sphere_solver.hpp"
 
 using cgp::mesh_drawable;
 
@@ -12,6 +14,8 @@ using cgp::mesh_drawable;
 struct gui_parameters {
 	bool display_frame = true;
 	bool add_sphere = true;
+	int capacity = 2000;   // Maximal number of spheres
+	float radius = 0.08f;  // Radius of the new spheres (small radii are needed to fit tens of thousands of spheres in the box)
 };
 
 // The structure of the custom scene
@@ -33,7 +37,8 @@ struct scene_structure : scene_inputs_generic {
 	// Elements and shapes of the scene
 	// ****************************** //
 	cgp::timer_event_periodic timer;
-	std::vector<particle_structure> particles;
+	particle_pool_structure particles; // Fixed-capacity storage of the spheres
+	sphere_solver_structure solver;    // Intermediate buffers of the simulation of the spheres
 	cgp::mesh_drawable sphere;
 	cgp::curve_drawable cube_wireframe;
 
@@ -52,6 +57,7 @@ struct scene_structure : scene_inputs_generic {
 	void idle_frame();
 
 	void emit_particle();
+	void fill_pool();     // Fill the free slots of the pool with spheres on a grid (large scenes, e.g. for benchmarking)
 	void simulation_step(float dt);
 	void sphere_display();
 };
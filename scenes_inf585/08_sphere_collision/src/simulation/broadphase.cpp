@@ -0,0 +1,164 @@
+#include "broadphase.hpp"
+
+using namespace cgp;
+
+
+int3 broadphase_grid_structure::cell(vec3 const& p) const
+{
+	vec3 const u = (p - origin) / cell_size;
+	return {
+		std::min(std::max(int(std::floor(u.x)), 0), dimension.x - 1),
+		std::min(std::max(int(std::floor(u.y)), 0), dimension.y - 1),
+		std::min(std::max(int(std::floor(u.z)), 0), dimension.z - 1) };
+}
+
+int broadphase_grid_structure::index(int3 const& c) const
+{
+	return c.x + dimension.x * (c.y + dimension.y * c.z);
+}
+
+void broadphase_grid_structure::build(particle_arrays_structure const& particles_arg, std::vector<char> const& alive, float margin_arg)
+{
+	margin = margin_arg;
+	int const N = particles_arg.size();
+	cell_of.resize(N);
+	large.clear();
+	particles.clear();
+
+	// Radius of the cells: largest radius of the regular particles
+	float mean_radius = 0.0f;
+	int N_alive = 0;
+	for (int k = 0; k < N; ++k) {
+		if (alive[k]) {
+			mean_radius += particles_arg.r[k];
+			N_alive++;
+		}
+	}
+	mean_radius /= std::max(N_alive, 1);
+
+	radius_cell = 0.0f;
+	vec3 p_min = { 0,0,0 }, p_max = { 0,0,0 };
+	bool first = true;
+	for (int k = 0; k < N; ++k) {
+		if (!alive[k])
+			continue;
+		if (particles_arg.r[k] > large_radius_ratio * mean_radius) {
+			large.push_back(k);
+			continue;
+		}
+		radius_cell = std::max(radius_cell, particles_arg.r[k]);
+		vec3 const p = particles_arg.position(k);
+		if (first) {
+			p_min = p;
+			p_max = p;
+			first = false;
+		}
+		for (int d = 0; d < 3; ++d) {
+			p_min[d] = std::min(p_min[d], p[d]);
+			p_max[d] = std::max(p_max[d], p[d]);
+		}
+	}
+
+	// Grid covering the bounding box of the regular particles
+	//  The cells are enlarged if a particle escaped far away, so that the number of cells stays proportional to N
+	cell_size = std::max(2 * radius_cell + margin, 1e-6f);
+	origin = p_min;
+	vec3 const extent = p_max - p_min;
+	long long const max_cells = 8 * (long long)N_alive + 64;
+	while (true) {
+		dimension = { int(extent.x / cell_size) + 1, int(extent.y / cell_size) + 1, int(extent.z / cell_size) + 1 };
+		if ((long long)dimension.x * dimension.y * dimension.z <= max_cells)
+			break;
+		cell_size *= 2;
+	}
+	int const N_cell = dimension.x * dimension.y * dimension.z;
+
+	// Counting sort of the regular particles by cell
+	cell_start.assign(N_cell + 1, 0);
+	for (int k = 0; k < N; ++k)
+		cell_of[k] = -1;
+	for (int k = 0; k < N; ++k) {
+		if (!alive[k] || particles_arg.r[k] > large_radius_ratio * mean_radius)
+			continue;
+		cell_of[k] = index(cell(particles_arg.position(k)));
+		cell_start[cell_of[k] + 1]++;
+	}
+	for (int c = 0; c < N_cell; ++c)
+		cell_start[c + 1] += cell_start[c];
+
+	particles.resize(cell_start[N_cell]);
+	fill.assign(cell_start.begin(), cell_start.end() - 1);
+	for (int k = 0; k < N; ++k)
+		if (cell_of[k] >= 0)
+			particles[fill[cell_of[k]]++] = k;
+}
+
+// Add the pair (i,j) if the two spheres overlap (up to the margin)
+static void test_pair(particle_arrays_structure const& particles, int i, int j, float margin, std::vector<int2>& pairs)
+{
+	vec3 const d = particles.position(j) - particles.position(i);
+	float const r = particles.r[i] + particles.r[j] + margin;
+	if (dot(d, d) < r * r)
+		pairs.push_back({ std::min(i, j), std::max(i, j) });
+}
+
+void broadphase_grid_structure::find_pairs(particle_arrays_structure const& particles_arg, std::vector<int2>& pairs)
+{
+	int const N = particles_arg.size();
+	pairs.clear();
+
+	// Regular-regular pairs: 27 neighboring cells
+	//  The particles are split in a fixed number of chunks, each one filling its own list of pairs:
+	//  the concatenation of the lists in the chunk order doesn't depend on the number of threads
+	int const N_chunk = 64;
+	chunk_pairs.resize(N_chunk);
+
+	#pragma omp parallel for schedule(dynamic)
+	for (int chunk = 0; chunk < N_chunk; ++chunk) {
+		std::vector<int2>& local_pairs = chunk_pairs[chunk];
+		local_pairs.clear();
+
+		for (int i = chunk * N / N_chunk; i < (chunk + 1) * N / N_chunk; ++i) {
+			if (cell_of[i] < 0)
+				continue;
+			int3 const c = cell(particles_arg.position(i));
+			int3 const c_min = { std::max(c.x - 1, 0), std::max(c.y - 1, 0), std::max(c.z - 1, 0) };
+			int3 const c_max = { std::min(c.x + 1, dimension.x - 1), std::min(c.y + 1, dimension.y - 1), std::min(c.z + 1, dimension.z - 1) };
+			for (int z = c_min.z; z <= c_max.z; ++z) {
+				for (int y = c_min.y; y <= c_max.y; ++y) {
+					for (int x = c_min.x; x <= c_max.x; ++x) {
+						int const cell_index = index({ x, y, z });
+						for (int k = cell_start[cell_index]; k < cell_start[cell_index + 1]; ++k) {
+							int const j = particles[k];
+							if (j > i)
+								test_pair(particles_arg, i, j, margin, local_pairs);
+						}
+					}
+				}
+			}
+		}
+	}
+	for (int chunk = 0; chunk < N_chunk; ++chunk)
+		pairs.insert(pairs.end(), chunk_pairs[chunk].begin(), chunk_pairs[chunk].end());
+
+	// Large-regular pairs: cells overlapped by the bounding box of the large sphere, enlarged by the radius of the regular particles and the margin
+	for (int i : large) {
+		vec3 const p = particles_arg.position(i);
+		vec3 const e = vec3(1, 1, 1) * (particles_arg.r[i] + radius_cell + margin);
+		int3 const c_min = cell(p - e);
+		int3 const c_max = cell(p + e);
+		for (int z = c_min.z; z <= c_max.z; ++z)
+			for (int y = c_min.y; y <= c_max.y; ++y)
+				for (int x = c_min.x; x <= c_max.x; ++x) {
+					int const cell_index = index({ x, y, z });
+					for (int k = cell_start[cell_index]; k < cell_start[cell_index + 1]; ++k)
+						test_pair(particles_arg, i, particles[k], margin, pairs);
+				}
+	}
+
+	// Large-large pairs: brute force on the (few) large particles
+	int const N_large = int(large.size());
+	for (int a = 0; a < N_large; ++a)
+		for (int b = a + 1; b < N_large; ++b)
+			test_pair(particles_arg, large[a], large[b], margin, pairs);
+}
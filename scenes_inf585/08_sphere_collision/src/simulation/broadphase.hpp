@@ -0,0 +1,44 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+#include "simulation.hpp"
+
+
+// Broadphase of the sphere-sphere collisions on a uniform grid
+//  - The grid covers the bounding box of the particles, with cells of size 2*r_cell+margin: the spheres of radius <= r_cell that
+//    may be closer than the margin to a given sphere are all in the 27 cells surrounding its center.
+//  - The particles are stored as a single array sorted by cell (counting sort): no allocation once the arrays reached their size.
+//  - Mixed radii: r_cell is the largest radius of the "regular" particles (radius <= large_radius_ratio x mean radius).
+//    The few larger spheres are not stored in the grid (they would make all the cells large), they look instead for their
+//    neighbors in all the cells overlapped by their bounding box, and are tested between each other.
+//  The candidate pairs are found in a time linear in the number of particles (for a bounded density).
+struct broadphase_grid_structure {
+
+    float cell_size = 1.0f;
+    float radius_cell = 0.5f;              // Largest radius of the particles stored in the grid
+    float large_radius_ratio = 4.0f;       // Particles with a radius larger than large_radius_ratio x mean radius are handled apart
+    float margin = 0.0f;                   // Additional distance of the pairs (e.g. relative displacement during the time step)
+    cgp::vec3 origin;                      // Corner of the cell (0,0,0)
+    cgp::int3 dimension;                   // Number of cells along each axis
+
+    std::vector<int> cell_start;           // Particles of the cell c are particles[cell_start[c] .. cell_start[c+1]-1]
+    std::vector<int> particles;            // Indices of the particles sorted by cell
+    std::vector<int> cell_of;              // Cell of each particle (-1 for the large and the dead particles)
+    std::vector<int> large;                // Indices of the large particles
+
+    // Fill the grid with the current positions of the alive particles
+    void build(particle_arrays_structure const& particles, std::vector<char> const& alive, float margin = 0.0f);
+
+    // Fill pairs with all the pairs (i,j), i<j, of overlapping spheres, up to the margin (|pi-pj| < ri+rj+margin)
+    //  The search is parallel, the pairs are always given in the same order whatever the number of threads
+    //  (sorted by i for the regular particles, followed by the pairs involving large particles).
+    void find_pairs(particle_arrays_structure const& particles, std::vector<cgp::int2>& pairs);
+
+    cgp::int3 cell(cgp::vec3 const& p) const; // Cell containing p, clamped to the grid
+    int index(cgp::int3 const& c) const;
+
+private:
+    // Buffers kept between the calls to avoid reallocations
+    std::vector<int> fill;                           // Insertion position of each cell during the counting sort
+    std::vector<std::vector<cgp::int2>> chunk_pairs; // Pairs found by each chunk of particles (find_pairs)
+};
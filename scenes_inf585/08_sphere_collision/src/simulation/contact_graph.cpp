@@ -0,0 +1,45 @@
+#include "contact_graph.hpp"
+
+using namespace cgp;
+
+
+int contact_graph_structure::number_of_colors() const
+{
+	return int(color_start.size()) - 1;
+}
+
+void contact_graph_structure::build(std::vector<int2> const& contacts_arg, int N_particle)
+{
+	int const N_contact = int(contacts_arg.size());
+	int const N_color = N_color_parallel + 1;
+
+	// Greedy coloring: bit c of used_colors[k] is set if the particle k already has a contact of color c
+	used_colors.assign(N_particle, 0);
+	color_of.resize(N_contact);
+	for (int k = 0; k < N_contact; ++k) {
+		int const i = contacts_arg[k].x;
+		int const j = contacts_arg[k].y;
+		uint64_t const used = used_colors[i] | used_colors[j];
+
+		int color = 0;
+		while (color < N_color_parallel && (used & (uint64_t(1) << color)))
+			color++;
+		if (color < N_color_parallel) {
+			used_colors[i] |= uint64_t(1) << color;
+			used_colors[j] |= uint64_t(1) << color;
+		}
+		color_of[k] = color;
+	}
+
+	// Stable counting sort of the contacts by color
+	color_start.assign(N_color + 1, 0);
+	for (int k = 0; k < N_contact; ++k)
+		color_start[color_of[k] + 1]++;
+	for (int c = 0; c < N_color; ++c)
+		color_start[c + 1] += color_start[c];
+
+	fill.assign(color_start.begin(), color_start.end() - 1);
+	contacts.resize(N_contact);
+	for (int k = 0; k < N_contact; ++k)
+		contacts[fill[color_of[k]]++] = contacts_arg[k];
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+#include <cstdint>
+
+
+// Coloring of the contact graph (vertices: particles, edges: contacts), to solve the contacts in parallel
+//  - Greedy coloring in the order of the contacts: each contact takes the first color not yet used by its two particles.
+//    Two contacts of the same color never share a particle: they can be solved concurrently without conflict, and in any order.
+//  - The colors are processed one after the other, the result doesn't depend on the number of threads.
+//  - The number of colors is bounded by twice the maximal number of contacts per particle (about 12 for spheres of similar radii).
+//    The contacts that don't find a color among the N_color_parallel first ones (e.g. around a large sphere) are put in a last color, solved serially.
+struct contact_graph_structure {
+
+    static int const N_color_parallel = 64;
+
+    std::vector<cgp::int2> contacts;  // Contacts sorted by color
+    std::vector<int> color_start;     // Contacts of the color c are contacts[color_start[c] .. color_start[c+1]-1] (N_color_parallel+1 colors)
+
+    // Color the given contacts between N_particle particles
+    void build(std::vector<cgp::int2> const& contacts, int N_particle);
+
+    int number_of_colors() const;
+
+private:
+    // Buffers kept between the calls to avoid reallocations
+    std::vector<uint64_t> used_colors; // Bit c of used_colors[k] is set if the particle k already has a contact of color c
+    std::vector<int> color_of;         // Color of each contact
+    std::vector<int> fill;             // Insertion position of each color during the counting sort
+};
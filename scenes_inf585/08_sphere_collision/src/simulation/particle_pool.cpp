@@ -0,0 +1,67 @@
+#include "particle_pool.hpp"
+
+using namespace cgp;
+
+
+void particle_pool_structure::initialize(int capacity_arg)
+{
+	particles.resize(capacity_arg);
+	alive.assign(capacity_arg, 0);
+	birth_time.assign(capacity_arg, 0.0f);
+
+	// The slots are given by increasing index
+	free_slots.resize(capacity_arg);
+	for (int k = 0; k < capacity_arg; ++k)
+		free_slots[k] = capacity_arg - 1 - k;
+}
+
+int particle_pool_structure::capacity() const
+{
+	return particles.size();
+}
+
+int particle_pool_structure::size() const
+{
+	return capacity() - int(free_slots.size());
+}
+
+void particle_pool_structure::remove(int k)
+{
+	if (!alive[k])
+		return;
+	alive[k] = 0;
+	free_slots.push_back(k);
+}
+
+int particle_pool_structure::emit(particle_structure const& particle, float time)
+{
+	if (free_slots.empty()) {
+		if (!recycle_oldest || capacity() == 0)
+			return -1;
+
+		int oldest = 0;
+		for (int k = 1; k < capacity(); ++k)
+			if (birth_time[k] < birth_time[oldest])
+				oldest = k;
+		remove(oldest);
+	}
+
+	int const k = free_slots.back();
+	free_slots.pop_back();
+	particles.set(k, particle);
+	alive[k] = 1;
+	birth_time[k] = time;
+	return k;
+}
+
+void particle_pool_structure::retire(float time)
+{
+	if (!retire_by_age)
+		return;
+
+	int const N = capacity();
+	for (int k = 0; k < N; ++k) {
+		if (alive[k] && time - birth_time[k] > max_age)
+			remove(k);
+	}
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+#include "simulation.hpp"
+
+
+// Fixed-capacity storage of the particles
+//  - All the arrays are allocated once (initialize): emitting and retiring particles never reallocates memory.
+//  - The particles are stored in slots, alive[k] tells if the slot k contains a particle. The free slots are stored in a free list.
+//  - Retirement policies (may be combined):
+//     - retire_by_age:     particles older than max_age are removed
+//     - recycle_oldest:    when the pool is full, the oldest particle is replaced by the new one (otherwise the emission is skipped)
+//    (the particles never leave the box: the collision with the walls keeps their center in [-1,1]^3)
+//  The number of particles - and thus the cost of the simulation - is bounded by the capacity.
+struct particle_pool_structure {
+
+    bool retire_by_age = false;
+    float max_age = 20.0f;
+    bool recycle_oldest = true;
+
+    particle_arrays_structure particles;       // Slots of the particles (size = capacity)
+    std::vector<char> alive;                   // alive[k] = 1 if the slot k contains a particle
+    std::vector<float> birth_time;             // Time of emission of the particle of each slot
+    std::vector<int> free_slots;               // Free list (the next slot given is the last one)
+
+    // Allocate the pool with a given capacity (all the slots are free)
+    void initialize(int capacity);
+
+    // Add a particle in a free slot (or in place of the oldest one if recycle_oldest is set)
+    //  Return the slot of the particle, or -1 if the pool is full.
+    int emit(particle_structure const& particle, float time);
+
+    // Remove the particles matching the retirement policies
+    void retire(float time);
+
+    // Free the slot k
+    void remove(int k);
+
+    int capacity() const;
+    int size() const; // Number of alive particles
+};
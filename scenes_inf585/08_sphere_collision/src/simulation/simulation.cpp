@@ -1,77 +1,321 @@
 #include "simulation.hpp"
+#include "sphere_solver.hpp"
 
 using namespace cgp;
 
 //#undef SOLUTION
 
 
+// Relative distance under which two spheres (or a sphere and a wall) are considered in contact
+//  The continuous collision detection stops the spheres exactly at contact: the impulse is then applied by the discrete test of the next substep.
+static float const contact_tolerance = 1e-3f;
 
-void simulate(std::vector<particle_structure>& particles, float dt_arg)
+// Impulse response between two spheres in contact that are getting closer
+static void collision_impulse(particle_arrays_structure& P, int i, int j, float alpha)
 {
+	vec3 const d = P.position(j) - P.position(i);
+	float const L = norm(d);
+	if (L < 1e-6f || L >= (P.r[i] + P.r[j]) * (1 + contact_tolerance))
+		return;
+	vec3 const u = d / L;
+
+	vec3 const v1 = P.velocity(i);
+	vec3 const v2 = P.velocity(j);
+	float const v_rel = dot(v2 - v1, u);
+	if (v_rel >= 0)
+		return;
+	float const J = -(1 + alpha) * v_rel / (1 / P.m[i] + 1 / P.m[j]);
+	P.set_velocity(i, v1 - (J / P.m[i]) * u);
+	P.set_velocity(j, v2 + (J / P.m[j]) * u);
+}
+
+// Separate two interpenetrating spheres (displacement weighted by the inverse masses), and cancel their approaching velocity
+static void collision_penetration(particle_arrays_structure& P, int i, int j)
+{
+	vec3 const p1 = P.position(i);
+	vec3 const p2 = P.position(j);
+	vec3 const d = p2 - p1;
+	float const L = norm(d);
+	float const depth = P.r[i] + P.r[j] - L;
+	if (L < 1e-6f || depth <= 0)
+		return;
+	vec3 const u = d / L;
+
+	float const w1 = (1 / P.m[i]) / (1 / P.m[i] + 1 / P.m[j]);
+	float const w2 = 1 - w1;
+	P.set_position(i, p1 - (w1 * depth) * u);
+	P.set_position(j, p2 + (w2 * depth) * u);
+
+	vec3 const v1 = P.velocity(i);
+	vec3 const v2 = P.velocity(j);
+	float const v_rel = dot(v2 - v1, u);
+	if (v_rel < 0) {
+		P.set_velocity(i, v1 + (w2 * v_rel) * u);
+		P.set_velocity(j, v2 - (w1 * v_rel) * u);
+	}
+}
+
+// Time of impact in [0,dt] of two spheres moving at constant velocity (dt if they don't collide within the time step)
+//  Solution of |d + t w| = r1+r2, with d and w the relative position and velocity. The spheres already in contact are left to the discrete collision handling.
+static float time_of_impact(particle_arrays_structure const& P, int i, int j, float dt)
+{
+	vec3 const d = P.position(j) - P.position(i);
+	vec3 const w = P.velocity(j) - P.velocity(i);
+	float const R = P.r[i] + P.r[j];
+
+	float const b = dot(d, w);
+	float const c = dot(d, d) - R * R;
+	if (b >= 0 || dot(d, d) <= R * R * (1 + contact_tolerance) * (1 + contact_tolerance))
+		return dt;
+	float const a = dot(w, w);
+	float const delta = b * b - a * c;
+	if (delta < 0)
+		return dt;
+	float const t = c / (-b + std::sqrt(delta)); // Smallest root (-b-sqrt(delta))/a, written to avoid the cancellation
+	return std::min(std::max(t, 0.0f), dt);
+}
+
+
+// Vectorized kernels on one coordinate (x, y, or z) of all the particles, for the two faces of the cube [-1,1]^3 orthogonal to this axis
+//  The tests are written as selections between values that are computed anyway, and with non short-circuit logical operators (&, |):
+//  the loops have no branch and are vectorized (a computation only needed on one side of a selection would be moved to a branch by the compiler).
+
+// Impulse response with the faces p=-1 and p=1
+static void collision_impulse_walls(float const* p, float* v, float const* r, int N, float alpha)
+{
+	#pragma omp parallel for simd schedule(static)
+	for (int k = 0; k < N; ++k) {
+		float const pk = p[k], vk = v[k];
+		float const contact = r[k] * (1 + contact_tolerance);
+		bool const impact = ((pk + 1 < contact) & (vk < 0)) | ((1 - pk < contact) & (vk > 0));
+		v[k] = vk - (1 + alpha) * (impact ? vk : 0.0f);
+	}
+}
+
+// Projection of the spheres crossing the faces back inside the cube, and cancellation of their velocity going outside
+static void collision_penetration_walls(float* p, float* v, float const* r, int N)
+{
+	#pragma omp parallel for simd schedule(static)
+	for (int k = 0; k < N; ++k) {
+		float const pk = p[k], vk = v[k];
+		bool const below = pk < r[k] - 1;
+		bool const above = pk > 1 - r[k];
+		p[k] = std::min(std::max(pk, r[k] - 1), 1 - r[k]);
+		v[k] = ((below & (vk < 0)) | (above & (vk > 0))) ? 0.0f : vk;
+	}
+}
+
+// Time of impact with the faces (t_impact is decreased if a sphere reaches a face before)
+//  A sphere moving away from a face gets a huge time of impact with this face, the spheres already in contact are left to the discrete collision handling.
+static void time_of_impact_walls(float const* p, float const* v, float const* r, float* t_impact, int N)
+{
+	#pragma omp parallel for simd schedule(static)
+	for (int k = 0; k < N; ++k) {
+		float const pk = p[k], vk = v[k], tk = t_impact[k];
+		float const contact = r[k] * contact_tolerance;
+		float const d_low = pk + 1 - r[k];
+		float const d_high = 1 - pk - r[k];
+		float const t_low = d_low / std::max(-vk, 1e-20f);
+		float const t_high = d_high / std::max(vk, 1e-20f);
+		bool const impact_low = (d_low > contact) & (t_low < tk);
+		bool const impact_high = (d_high > contact) & (t_high < tk);
+		t_impact[k] = std::min(impact_low ? t_low : tk, impact_high ? t_high : tk);
+	}
+}
+
+
+// Solve the contacts color by color: the contacts of a color don't share any particle and are solved in parallel
+//  The last color gathers the contacts that couldn't be colored, and is solved serially.
+template <typename F>
+static void solve_contacts(contact_graph_structure const& graph, F const& solve)
+{
+	int const N_color = graph.number_of_colors();
+	for (int c = 0; c < N_color; ++c) {
+		int const start = graph.color_start[c];
+		int const end = graph.color_start[c + 1];
+		if (c < contact_graph_structure::N_color_parallel) {
+			#pragma omp parallel for schedule(static)
+			for (int k = start; k < end; ++k)
+				solve(graph.contacts[k]);
+		}
+		else {
+			for (int k = start; k < end; ++k)
+				solve(graph.contacts[k]);
+		}
+	}
+}
+
+
+void simulate(particle_arrays_structure& particles, std::vector<char> const& alive, float dt_arg, sphere_solver_structure& solver)
+{
+
+	float const alpha = 0.8f; // Restitution coefficient of the impacts
+
+	float const max_displacement = 1.0f; // Maximal displacement of a sphere during a substep, relative to its radius
+	int const max_substep = 10;
+
+	broadphase_grid_structure& grid = solver.grid;
+	contact_graph_structure& contact_graph = solver.contact_graph;
+	std::vector<int2>& pairs = solver.pairs;
+	std::vector<int2>& contacts = solver.contacts;
+	std::vector<char>& in_contact = solver.in_contact;
+	std::vector<float>& t_impact = solver.t_impact;
+	std::vector<float>& t_impact_pair = solver.t_impact_pair;
+
+	int const N = particles.size();
+	t_impact.resize(N);
+
+	float* const px = particles.px.data();
+	float* const py = particles.py.data();
+	float* const pz = particles.pz.data();
+	float* const vx = particles.vx.data();
+	float* const vy = particles.vy.data();
+	float* const vz = particles.vz.data();
+	float const* const r = particles.r.data();
+	float* const t = t_impact.data();
+
+	// Adaptive number of substeps
+	//  The continuous collision detection prevents the tunnelling: the substeps are only needed for the accuracy of the fast spheres,
+	//  that are stopped at their first impact during a substep.
+	float displacement = 0.0f;
+	for (int k = 0; k < N; ++k)
+		if (alive[k])
+			displacement = std::max(displacement, norm(particles.velocity(k)) * dt_arg / r[k]);
+	int const N_substep = std::min(std::max(int(std::ceil(displacement / max_displacement)), 1), max_substep);
 
-	size_t const N_substep = 10;
 	float const dt = dt_arg / N_substep;
-	for (size_t k_substep = 0; k_substep < N_substep; ++k_substep)
+	for (int k_substep = 0; k_substep < N_substep; ++k_substep)
 	{
 
 		vec3 const g = { 0,0,-9.81f };
-		size_t const N = particles.size();
 
 		// Update velocity with gravity force and friction
-		for (size_t k = 0; k < N; ++k)
+		float const damping = 1 - 0.9f * dt;
+		#pragma omp parallel for simd schedule(static)
+		for (int k = 0; k < N; ++k)
 		{
-			particle_structure& particle = particles[k];
-			vec3 const f = particle.m * g;
+			vx[k] = damping * vx[k] + dt * g.x;
+			vy[k] = damping * vy[k] + dt * g.y;
+			vz[k] = damping * vz[k] + dt * g.z;
+		}
+
+		// Candidate pairs of colliding spheres: pairs that may be in contact during the substep
+		float v_max = 0.0f;
+		for (int k = 0; k < N; ++k)
+			if (alive[k])
+				v_max = std::max(v_max, norm(particles.velocity(k)));
+		grid.build(particles, alive, 2 * v_max * dt);
+		grid.find_pairs(particles, pairs);
 
-			particle.v = (1 - 0.9f * dt) * particle.v + dt * f / particle.m;
+		// Contacts: pairs of spheres currently touching, colored to be solved in parallel
+		int const N_pair = int(pairs.size());
+		in_contact.resize(N_pair);
+		#pragma omp parallel for schedule(static)
+		for (int k = 0; k < N_pair; ++k) {
+			int const i = pairs[k].x;
+			int const j = pairs[k].y;
+			float const R = (r[i] + r[j]) * (1 + contact_tolerance);
+			vec3 const d = particles.position(j) - particles.position(i);
+			in_contact[k] = dot(d, d) < R * R;
 		}
+		contacts.clear();
+		for (int k = 0; k < N_pair; ++k)
+			if (in_contact[k])
+				contacts.push_back(pairs[k]);
+		contact_graph.build(contacts, N);
+
+		// Impulse response for bouncing effect
+		solve_contacts(contact_graph, [&](int2 const& contact) { collision_impulse(particles, contact.x, contact.y, alpha); });
+		collision_impulse_walls(px, vx, r, N, alpha);
+		collision_impulse_walls(py, vy, r, N, alpha);
+		collision_impulse_walls(pz, vz, r, N, alpha);
+
+		// Cancel the penetration and the velocity components going inside the other particle / outside the cube
+		solve_contacts(contact_graph, [&](int2 const& contact) { collision_penetration(particles, contact.x, contact.y); });
+		collision_penetration_walls(px, vx, r, N);
+		collision_penetration_walls(py, vy, r, N);
+		collision_penetration_walls(pz, vz, r, N);
 
-		// **************************************** //
-		// TO DO: Collision Handling
-		// 
-		// The global pseudo code may be the following:
-		//  (you need to implement steps 2 and 3)
-		// 
-		//   1: Velocity update with force fields (already implemented)
-		//   - For all particles:
-		//     Update velocity using gravity and friction 
-		//  
-		//   2: Impulse response for bouncing effect
-		//   - For all particles:
-		//     Check collision between particles 
-		//      Then update their velocities using impulse response
-		//   - For all particles:
-		//     Check collision between cube faces 
-		//      Then update their velocities using impulse response
-		//
-		//   3: Cancel velocity components in penetration
-		//   - For all particles:
-		//     Check collision between particles 
-		//      Then cancel velocity components going inside other particle
-		//   - For all particles:
-		//     Check collision between cube faces 
-		//      Then cancel velocity components going outside the cube
-		//
-		//   4: Position update (already implemented)
-		// 	 - For all particles:
-		//     Update position using the velocity
-		//
-		//  Hints:
-		//    - The cube is by default centered around zero, faces are between [-1,1]
-		//      To compute the intersection between sphere and cube faces, you may store
-		//      the normals, and face center positions of the cube in a vectors.
-		//
-		//    - Implement and check first the collision between the spheres and the cube
-		//      before the collision between spheres
-		//
-		// **************************************** //
+		// Continuous collision detection: each sphere moves until its first impact during the substep
+		t_impact_pair.resize(N_pair);
+		#pragma omp parallel for schedule(static)
+		for (int k = 0; k < N_pair; ++k)
+			t_impact_pair[k] = time_of_impact(particles, pairs[k].x, pairs[k].y, dt);
+
+		#pragma omp parallel for simd schedule(static)
+		for (int k = 0; k < N; ++k)
+			t[k] = dt;
+		time_of_impact_walls(px, vx, r, t, N);
+		time_of_impact_walls(py, vy, r, t, N);
+		time_of_impact_walls(pz, vz, r, t, N);
+		for (int k = 0; k < N_pair; ++k) {
+			t[pairs[k].x] = std::min(t[pairs[k].x], t_impact_pair[k]);
+			t[pairs[k].y] = std::min(t[pairs[k].y], t_impact_pair[k]);
+		}
 
 		// Update position from velocity
-		for (size_t k = 0; k < N; ++k)
+		#pragma omp parallel for simd schedule(static)
+		for (int k = 0; k < N; ++k)
 		{
-			particle_structure& particle = particles[k];
-			particle.p = particle.p + dt * particle.v;
+			px[k] = px[k] + t[k] * vx[k];
+			py[k] = py[k] + t[k] * vy[k];
+			pz[k] = pz[k] + t[k] * vz[k];
 		}
 	}
 
 }
+
+
+void particle_arrays_structure::resize(int N)
+{
+	px.resize(N); py.resize(N); pz.resize(N);
+	vx.resize(N); vy.resize(N); vz.resize(N);
+	r.resize(N);
+	m.resize(N);
+	c.resize(N);
+}
+
+int particle_arrays_structure::size() const
+{
+	return int(r.size());
+}
+
+void particle_arrays_structure::set(int k, particle_structure const& particle)
+{
+	set_position(k, particle.p);
+	set_velocity(k, particle.v);
+	r[k] = particle.r;
+	m[k] = particle.m;
+	c[k] = particle.c;
+}
+
+particle_structure particle_arrays_structure::get(int k) const
+{
+	particle_structure particle;
+	particle.p = position(k);
+	particle.v = velocity(k);
+	particle.r = r[k];
+	particle.m = m[k];
+	particle.c = c[k];
+	return particle;
+}
+
+vec3 particle_arrays_structure::position(int k) const
+{
+	return { px[k], py[k], pz[k] };
+}
+
+vec3 particle_arrays_structure::velocity(int k) const
+{
+	return { vx[k], vy[k], vz[k] };
+}
+
+void particle_arrays_structure::set_position(int k, vec3 const& p)
+{
+	px[k] = p.x; py[k] = p.y; pz[k] = p.z;
+}
+
+void particle_arrays_structure::set_velocity(int k, vec3 const& v)
+{
+	vx[k] = v.x; vy[k] = v.y; vz[k] = v.z;
+}
@@ -14,5 +14,34 @@ struct particle_structure
 };
 
 
-void simulate(std::vector<particle_structure>& particles, float dt);
+// Storage of a set of particles as a structure of arrays (SoA)
+//  The loops of the simulation (integration, walls) only stream the arrays they need, one float per particle and per coordinate,
+//  and are vectorized. The color, only used for the display, is stored apart.
+struct particle_arrays_structure
+{
+    std::vector<float> px, py, pz; // Position
+    std::vector<float> vx, vy, vz; // Speed
+    std::vector<float> r;          // Radius
+    std::vector<float> m;          // Mass
+
+    std::vector<cgp::vec3> c;      // Color (cold data)
+
+    void resize(int N);
+    int size() const;
+
+    void set(int k, particle_structure const& particle);
+    particle_structure get(int k) const;
+
+    cgp::vec3 position(int k) const;
+    cgp::vec3 velocity(int k) const;
+    void set_position(int k, cgp::vec3 const& p);
+    void set_velocity(int k, cgp::vec3 const& v);
+};
+
+
+struct sphere_solver_structure; // See sphere_solver.hpp
 
+// Simulate the particles k such that alive[k] is set
+//  The other slots are ignored by the collisions between spheres (their values are still updated by the vectorized loops, but never used).
+//  solver: intermediate buffers of the simulation, owned by the caller
+void simulate(particle_arrays_structure& particles, std::vector<char> const& alive, float dt, sphere_solver_structure& solver);
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+#include "simulation.hpp"
+#include "broadphase.hpp"
+#include "contact_graph.hpp"
+
+
+// Intermediate data of the simulation of a set of spheres (see simulate)
+//  They are kept between the time steps to avoid reallocations, and don't carry any state from one step to the next:
+//  each set of particles uses its own solver (several scenes or pools can be simulated concurrently).
+struct sphere_solver_structure
+{
+    broadphase_grid_structure grid;        // Broadphase of the sphere-sphere collisions
+    contact_graph_structure contact_graph; // Contacts colored to be solved in parallel
+
+    std::vector<cgp::int2> pairs;          // Candidate pairs of colliding spheres during the substep
+    std::vector<cgp::int2> contacts;       // Pairs of spheres currently touching
+    std::vector<char> in_contact;          // in_contact[k] = 1 if the pair k is a contact
+    std::vector<float> t_impact;           // Time of the first impact of each sphere during the substep
+    std::vector<float> t_impact_pair;      // Time of impact of each pair
+};
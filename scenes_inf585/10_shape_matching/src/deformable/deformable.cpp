@@ -1,4 +1,5 @@
 #include "deformable.hpp"
+#include "../../third_party/eigen/Eigen/LU"
 
 
 
@@ -7,40 +8,109 @@ void shape_deformable_structure::initialize(cgp::mesh const& shape)
     drawable.initialize_data_on_gpu(shape);
 
 	position = shape.position;
-	position_reference = position;
-	position_predict = position;
 	normal = shape.normal;
 	connectivity = shape.connectivity;
+	N_vertex = position.size();
+	normal_per_vertex(position, connectivity, normal_reference);
 
+	rotation = cgp::mat3::build_identity();
+}
+
+Eigen::Matrix<float,9,1> quadratic_terms(cgp::vec3 const& q)
+{
+    Eigen::Matrix<float,9,1> qt;
+    qt << q.x, q.y, q.z, q.x*q.x, q.y*q.y, q.z*q.z, q.x*q.y, q.y*q.z, q.z*q.x;
+    return qt;
+}
+
+// Matrix T such that q~(S q) = T q~(q) for the linear map S
+static Eigen::Matrix<float,9,9> quadratic_transform(cgp::mat3 const& S)
+{
+    // The quadratic term 3+m is q_a q_b with (a,b) = (pair_a[m],pair_b[m])
+    int const pair_a[6] = {0,1,2,0,1,2};
+    int const pair_b[6] = {0,1,2,1,2,0};
+
+    Eigen::Matrix<float,9,9> T = Eigen::Matrix<float,9,9>::Zero();
+    for(int a=0; a<3; ++a)
+        for(int c=0; c<3; ++c)
+            T(a,c) = S(a,c);
 
-	velocity.resize(position.size());
-	com = average(position);
-	com_reference = average(position_reference);
+    // (Sq)_a (Sq)_b = sum_{c,d} S_ac S_bd q_c q_d
+    for(int m=0; m<6; ++m) {
+        int const a = pair_a[m], b = pair_b[m];
+        for(int n=0; n<6; ++n) {
+            int const c = pair_a[n], d = pair_b[n];
+            T(3+m,3+n) = (c==d) ? S(a,c)*S(b,c) : S(a,c)*S(b,d) + S(a,d)*S(b,c);
+        }
+    }
+    return T;
 }
 
-void shape_deformable_structure::set_position_and_velocity(cgp::vec3 translation, cgp::vec3 linear_velocity, cgp::vec3 angular_velocity)
+void shape_deformable_structure::initialize_reference(cgp::numarray<cgp::vec3> const& position_reference, cgp::numarray<cgp::vec3>& offset_reference)
 {
-    // Apply the translation
-	position = add(position, translation); 
-    // Update the center of mass
-	com = average(position);
-
-	// Add linear velocity to the velocity structure
-	velocity = add(velocity,linear_velocity);
-
-	// Add angular velocity to the velocity structure
-	for(int k=0; k<size(); ++k) {
-		velocity[k] += cross(angular_velocity, position[k]-com);
-	}
+    // The sums are computed in double precision: the quadratic moments are badly scaled for small shapes
+    Eigen::Matrix3d Aqq = Eigen::Matrix3d::Zero();
+    Eigen::Matrix<double,9,9> Aqq_quadratic = Eigen::Matrix<double,9,9>::Zero();
+    for(int k=0; k<N_vertex; ++k) {
+        cgp::vec3 const q = position_reference[offset+k] - com_reference;
+        offset_reference[offset+k] = q;
+        reference_radius = std::max(reference_radius, quadratic_terms(q).norm());
+
+        Eigen::Matrix<double,9,1> const qt = quadratic_terms(q).cast<double>();
+        Aqq += qt.head<3>() * qt.head<3>().transpose();
+        Aqq_quadratic += qt * qt.transpose();
+    }
+
+    Eigen::Matrix3f const Aqq_inv = Aqq.inverse().cast<float>();
+    A_qq_rest = { Aqq_inv(0,0), Aqq_inv(0,1), Aqq_inv(0,2), Aqq_inv(1,0), Aqq_inv(1,1), Aqq_inv(1,2), Aqq_inv(2,0), Aqq_inv(2,1), Aqq_inv(2,2) };
+    A_qq_quadratic_rest = Aqq_quadratic.inverse().cast<float>();
+
+    A_qq = A_qq_rest;
+    A_qq_quadratic = A_qq_quadratic_rest;
+    plastic_deformation = cgp::mat3::build_identity();
+}
+
+void shape_deformable_structure::set_plastic_deformation(cgp::mat3 const& Sp, cgp::numarray<cgp::vec3> const& position_reference, cgp::numarray<cgp::vec3>& offset_reference)
+{
+    plastic_deformation = Sp;
+    reference_radius = 0.0f;
+    for(int k=0; k<N_vertex; ++k) {
+        offset_reference[offset+k] = Sp * (position_reference[offset+k] - com_reference);
+        reference_radius = std::max(reference_radius, quadratic_terms(offset_reference[offset+k]).norm());
+    }
+
+    // sum (Sp q)(Sp q)^T = Sp (sum q q^T) Sp^T
+    cgp::mat3 const Sp_inv = inverse(Sp);
+    A_qq = transpose(Sp_inv) * A_qq_rest * Sp_inv;
+
+    Eigen::Matrix<float,9,9> const T_inv = quadratic_transform(Sp).inverse();
+    A_qq_quadratic = T_inv.transpose() * A_qq_quadratic_rest * T_inv;
 }
 
 int shape_deformable_structure::size() const {
-    return position.size();
+    return N_vertex;
 }
 
 
-void shape_deformable_structure::update_drawable() {
+void shape_deformable_structure::update_position_and_normal(cgp::numarray<cgp::vec3> const& world_position, float rigid_tolerance) {
+    for(int k=0; k<N_vertex; ++k)
+        position[k] = world_position[offset+k];
+
+    // Rigid motion: the positions are the rigid goal positions of a reference shape that is not deformed plastically
+    bool rigid = rigid_residual <= rigid_tolerance;
+    for(int i=0; i<3 && rigid; ++i)
+        for(int j=0; j<3 && rigid; ++j)
+            rigid = std::abs(plastic_deformation(i,j) - (i==j ? 1.0f : 0.0f)) < 1e-6f;
+
+    if(rigid) {
+        for(int k=0; k<N_vertex; ++k)
+            normal[k] = rotation*normal_reference[k];
+    }
+    else
+        normal_per_vertex(position, connectivity, normal);
+}
+
+void shape_deformable_structure::update_vbo() {
     drawable.vbo_position.update(position);
-    normal_per_vertex(position, connectivity, normal);
     drawable.vbo_normal.update(normal);
 }
\ No newline at end of file
@@ -1,44 +1,89 @@
 #pragma once
 
 #include "cgp/cgp.hpp"
+#include "../../third_party/eigen/Eigen/Core"
+
+// Quadratic terms q~ = (x,y,z, x^2,y^2,z^2, xy,yz,zx) of an offset q (used by the quadratic shape matching)
+Eigen::Matrix<float,9,1> quadratic_terms(cgp::vec3 const& q);
 
 // Structure storing the data for the deformable structure simulation
-//  The structure stores the current deformed model parameters (position, normal, velocity, etc.), and parameter of the reference/initial one in order to compute the shape matching.
+//  The structure stores the per-shape parameters (center of mass, rotation, normal, etc.) in order to compute the shape matching.
+//  The particles (position, velocity, etc.) of all the shapes are stored contiguously in the deformable_world_structure,
+//   the particles of this shape being the range [offset, offset+N_vertex[ of the world arrays.
 struct shape_deformable_structure {
 
     // Center of mass of the deformed shape
 	cgp::vec3 com;
     // Center of mass of the reference shape
 	cgp::vec3 com_reference;
+    // Rotation computed by the last shape matching (used as initial guess of the next polar decomposition)
+	cgp::mat3 rotation;
 
-    // Positions of the deformed shape
-	cgp::numarray<cgp::vec3> position;
-    // Predicted positions of the deformed shape (used to apply the PPD constraints before updating the velocity)
-	cgp::numarray<cgp::vec3> position_predict;
-    // Positions of the reference shape
-	cgp::numarray<cgp::vec3> position_reference;
+    // Precomputed reference moment matrices of the shape matching [Muller et al. 2005, Meshless Deformations Based on Shape Matching]
+    //  with q the offsets of the reference positions to com_reference (world offset_reference), and q~ = (x,y,z, x^2,y^2,z^2, xy,yz,zx)(q)
+    //  - Linear: A_qq = (sum q q^T)^-1
+	cgp::mat3 A_qq;
+    //  - Quadratic: A_qq_quadratic = (sum q~ q~^T)^-1
+	Eigen::Matrix<float,9,9> A_qq_quadratic;
+    // Moment matrices of the initial reference shape (before any plastic deformation)
+	cgp::mat3 A_qq_rest;
+	Eigen::Matrix<float,9,9> A_qq_quadratic_rest;
+    // Plastic deformation of the reference shape: q = plastic_deformation (p_rest - com_reference)
+	cgp::mat3 plastic_deformation;
+    // Maximal norm of the quadratic terms q~ of the reference offsets (also bounds the norm of q)
+	float reference_radius = 0.0f;
+    // Bound of the distance between the goal positions of the last shape matching and the rigid ones R q + com (0 for a rigid shape matching)
+	float rigid_residual = 0.0f;
+
+    // Sleeping shape: at rest for a while, it is not simulated anymore (and its drawable is not updated) until it is woken up by a collision
+	bool sleeping = false;
+    // Number of consecutive time steps with a kinetic energy below the sleeping threshold
+	int calm_steps = 0;
+    // The drawable already displays the sleeping position of the shape
+	bool drawable_sleeping = false;
+    // Bounding box of the shape when it went to sleep (extended by the contact margin)
+	cgp::bounding_box sleeping_box;
+    // Sleeping shapes whose sleeping box overlaps the one of this shape (island of shapes at rest, woken up together)
+	std::vector<int> sleeping_neighbors;
 
-    // Velocity of the deformed shape
-	cgp::numarray<cgp::vec3> velocity;
+    // Index of the first particle of the shape in the world arrays
+	int offset = 0;
+    // Number of particles of the shape
+	int N_vertex = 0;
 
+    // Positions of the deformed shape copied from the world arrays (used for the display and the normals)
+	cgp::numarray<cgp::vec3> position;
     // Normals of the deformed shape
 	cgp::numarray<cgp::vec3> normal;
+    // Normals of the reference shape (rotated by the shape matching rotation when the shape moves rigidly)
+	cgp::numarray<cgp::vec3> normal_reference;
     // Connectivity of the mesh (used to recompute the per-vertex normals)
 	cgp::numarray<cgp::uint3> connectivity;
     // The drawable element representing the deformed shape
 	cgp::mesh_drawable drawable;
 
 
-    // Initialize a reference structure from a mesh
+    // Initialize the display data (drawable, normals, connectivity) from a mesh
 	void initialize(cgp::mesh const& shape);
 
-    // Set an initial translation and velocity to the deformed shape and update the com
-    void set_position_and_velocity(cgp::vec3 translation, cgp::vec3 linear_velocity, cgp::vec3 angular_velocity);
+    // Compute the reference offsets q of the particles of the shape and the moment matrices A_qq from the reference positions
+    //  position_reference, offset_reference: arrays of all the particles of the world
+	void initialize_reference(cgp::numarray<cgp::vec3> const& position_reference, cgp::numarray<cgp::vec3>& offset_reference);
+
+    // Set a new plastic deformation Sp of the reference shape: q = Sp (p_rest - com_reference)
+    //  The moment matrices are updated from the rest ones without summing over the particles: A_qq = Sp^-T A_qq_rest Sp^-1 (and similarly for the quadratic one).
+	void set_plastic_deformation(cgp::mat3 const& Sp, cgp::numarray<cgp::vec3> const& position_reference, cgp::numarray<cgp::vec3>& offset_reference);
 
     // Returns the number of positions
 	int size() const;
 
-    // Update the position and normals to the vbo of the drawable structure
-	void update_drawable();
+    // Copy the positions of the shape from the world arrays and update its normals (CPU part: can be called in parallel for different shapes)
+    //  world_position, world_offset_reference: the arrays of all the particles of the world
+    //  If the shape moves rigidly (rigid_residual below rigid_tolerance, and no plastic deformation),
+    //   the normals are the rotated reference normals instead of being recomputed from the triangles.
+	void update_position_and_normal(cgp::numarray<cgp::vec3> const& world_position, float rigid_tolerance);
+
+    // Update the position and normals to the vbo of the drawable structure (GPU part)
+	void update_vbo();
 
-};
\ No newline at end of file
+};
@@ -0,0 +1,128 @@
+#include "deformable_clusters.hpp"
+
+using namespace cgp;
+
+
+static bool same_matrix(mat3 const& a, mat3 const& b)
+{
+	for(int i=0; i<3; ++i)
+		for(int j=0; j<3; ++j)
+			if(a(i,j)!=b(i,j))
+				return false;
+	return true;
+}
+
+void deformable_clusters_structure::update(std::vector<shape_deformable_structure> const& shapes, numarray<vec3> const& offset_reference, float cluster_size_arg)
+{
+	if(cluster_size_arg!=cluster_size) {
+		*this = deformable_clusters_structure();
+		cluster_size = cluster_size_arg;
+	}
+
+	// The plastic deformation modifies offset_reference: the centers of mass and moment matrices of the clusters have to follow
+	for(int s=0; s<N_shape; ++s) {
+		if(!same_matrix(shapes[s].plastic_deformation, shape_plastic_deformation[s])) {
+			shape_plastic_deformation[s] = shapes[s].plastic_deformation;
+			update_reference(s, offset_reference);
+		}
+	}
+
+	for(; N_shape<int(shapes.size()); ++N_shape)
+		add_shape(shapes[N_shape], offset_reference);
+}
+
+int deformable_clusters_structure::size() const {
+	return int(start.size())-1;
+}
+
+void deformable_clusters_structure::add_shape(shape_deformable_structure const& shape, numarray<vec3> const& offset_reference)
+{
+	int const k0 = shape.offset;
+	int const N_vertex = shape.size();
+
+	// Voxel grid over the reference shape
+	//  (the number of voxels is bounded, in case of a cluster size much smaller than the shape)
+	vec3 p_min = offset_reference[k0], p_max = offset_reference[k0];
+	for(int k=k0; k<k0+N_vertex; ++k) {
+		vec3 const& q = offset_reference[k];
+		p_min = { std::min(p_min.x, q.x), std::min(p_min.y, q.y), std::min(p_min.z, q.z) };
+		p_max = { std::max(p_max.x, q.x), std::max(p_max.y, q.y), std::max(p_max.z, q.z) };
+	}
+	vec3 const extent = p_max - p_min;
+	float const h = std::max(cluster_size, std::max(extent.x, std::max(extent.y, extent.z)) / 64.0f) + 1e-6f;
+	int3 const N_voxel = { int(extent.x/h)+1, int(extent.y/h)+1, int(extent.z/h)+1 };
+
+	// Corner (x,y,z) of the grid, in [0,N_voxel]
+	int3 const N_corner = { N_voxel.x+1, N_voxel.y+1, N_voxel.z+1 };
+	auto corner_index = [&](int x, int y, int z) { return x + N_corner.x*(y + N_corner.y*z); };
+	auto voxel_of = [&](vec3 const& q) {
+		return int3{ std::min(int((q.x-p_min.x)/h), N_voxel.x-1), std::min(int((q.y-p_min.y)/h), N_voxel.y-1), std::min(int((q.z-p_min.z)/h), N_voxel.z-1) };
+	};
+
+	// The particles of the voxel v belong to the clusters of the corners v + {0,1}^3
+	std::vector<int> corner_count(N_corner.x*N_corner.y*N_corner.z, 0);
+	for(int k=k0; k<k0+N_vertex; ++k) {
+		int3 const v = voxel_of(offset_reference[k]);
+		for(int dz=0; dz<2; ++dz)
+			for(int dy=0; dy<2; ++dy)
+				for(int dx=0; dx<2; ++dx)
+					corner_count[corner_index(v.x+dx, v.y+dy, v.z+dz)]++;
+	}
+
+	// Non empty corners give the clusters (in the order of the corners)
+	int const c0 = size();
+	std::vector<int> corner_cluster(corner_count.size(), -1);
+	std::vector<int> fill;
+	for(int corner=0; corner<int(corner_count.size()); ++corner) {
+		if(corner_count[corner]==0)
+			continue;
+		corner_cluster[corner] = size();
+		fill.push_back(start.back());
+		start.push_back(start.back()+corner_count[corner]);
+	}
+	particles.resize(start.back());
+
+	// Fill the clusters (particles in increasing order), and the clusters of each particle
+	for(int k=k0; k<k0+N_vertex; ++k) {
+		int3 const v = voxel_of(offset_reference[k]);
+		for(int dz=0; dz<2; ++dz) {
+			for(int dy=0; dy<2; ++dy) {
+				for(int dx=0; dx<2; ++dx) {
+					int const c = corner_cluster[corner_index(v.x+dx, v.y+dy, v.z+dz)];
+					particles[fill[c-c0]++] = k;
+					particle_clusters.push_back(c);
+				}
+			}
+		}
+		particle_start.push_back(particle_clusters.size());
+	}
+
+	for(int c=c0; c<size(); ++c)
+		rotation.push_back(shape.rotation);
+	shape_start.push_back(size());
+	shape_plastic_deformation.push_back(shape.plastic_deformation);
+	update_reference(int(shape_start.size())-2, offset_reference);
+}
+
+void deformable_clusters_structure::update_reference(int shape_index, numarray<vec3> const& offset_reference)
+{
+	// Reference center of mass and moment matrix of the clusters of the shape
+	com_reference.resize(size());
+	A_qq.resize(size());
+	for(int c=shape_start[shape_index]; c<shape_start[shape_index+1]; ++c) {
+		vec3 com = {0,0,0};
+		for(int i=start[c]; i<start[c+1]; ++i)
+			com += offset_reference[particles[i]];
+		com /= float(start[c+1]-start[c]);
+
+		mat3 Aqq = mat3::build_zero();
+		for(int i=start[c]; i<start[c+1]; ++i) {
+			vec3 const q = offset_reference[particles[i]] - com;
+			Aqq += tensor_product(q, q);
+		}
+		float const trace = Aqq(0,0)+Aqq(1,1)+Aqq(2,2);
+
+		com_reference[c] = com;
+		A_qq[c] = det(Aqq) > 1e-4f*trace*trace*trace ? inverse(Aqq) : mat3::build_zero();
+	}
+}
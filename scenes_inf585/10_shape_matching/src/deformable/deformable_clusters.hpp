@@ -0,0 +1,47 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+#include "deformable.hpp"
+
+// Overlapping clusters of particles used by the region-based shape matching
+//  Each shape is covered by a voxel grid (voxels of size cluster_size) over its reference positions.
+//  The cluster associated to a corner of the grid contains the particles of the 2x2x2 voxels around this corner:
+//   each particle belongs to 8 clusters whatever the resolution of the mesh, and the clusters overlap over one voxel.
+//  The clusters of all the shapes are stored contiguously (one array per attribute), as the particles in the deformable_world_structure.
+struct deformable_clusters_structure {
+
+    // Size of the voxels used to build the clusters (0: not built yet)
+	float cluster_size = 0.0f;
+    // Number of shapes already clustered
+	int N_shape = 0;
+
+    // Particles of the cluster c: particles[start[c] .. start[c+1]-1] (indices in the world arrays)
+	std::vector<int> start = { 0 };
+	std::vector<int> particles;
+    // Clusters of the particle k: particle_clusters[particle_start[k] .. particle_start[k+1]-1]
+	std::vector<int> particle_start = { 0 };
+	std::vector<int> particle_clusters;
+    // Clusters of the shape s: shape_start[s] .. shape_start[s+1]-1
+	std::vector<int> shape_start = { 0 };
+    // Plastic deformation of the shape s when the reference data of its clusters (com_reference, A_qq) were computed
+	std::vector<cgp::mat3> shape_plastic_deformation;
+
+    // Center of mass of the cluster in the reference shape (in the coordinates of the world offset_reference)
+	std::vector<cgp::vec3> com_reference;
+    // Inverse moment matrix of the cluster A_qq = (sum q q^T)^-1 (zero for flat clusters)
+	std::vector<cgp::mat3> A_qq;
+    // Rotation computed by the last shape matching (used as initial guess of the next polar decomposition)
+	std::vector<cgp::mat3> rotation;
+
+
+    // Build the clusters of the shapes that are not clustered yet (of all the shapes if the cluster size changed)
+    //  The reference data of the clusters of a shape are recomputed when its plastic deformation changed (the particles of the clusters are kept)
+	void update(std::vector<shape_deformable_structure> const& shapes, cgp::numarray<cgp::vec3> const& offset_reference, float cluster_size);
+
+    // Number of clusters
+	int size() const;
+
+private:
+	void add_shape(shape_deformable_structure const& shape, cgp::numarray<cgp::vec3> const& offset_reference);
+	void update_reference(int shape_index, cgp::numarray<cgp::vec3> const& offset_reference);
+};
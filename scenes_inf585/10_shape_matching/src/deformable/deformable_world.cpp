@@ -0,0 +1,108 @@
+#include "deformable_world.hpp"
+
+#include <algorithm>
+
+using namespace cgp;
+
+
+shape_deformable_structure& deformable_world_structure::add(mesh const& shape, vec3 translation, vec3 linear_velocity, vec3 angular_velocity)
+{
+	shape_deformable_structure deformable;
+	deformable.initialize(shape);
+	deformable.offset = number_of_particles();
+
+	int const N_vertex = deformable.size();
+	int const kd = shapes.size();
+
+	// Reference shape, and its center of mass
+	deformable.com_reference = average(shape.position);
+	// Apply the translation and update the com
+	deformable.com = deformable.com_reference + translation;
+
+	for(int k=0; k<N_vertex; ++k) {
+		vec3 const p = shape.position[k] + translation;
+		position.push_back(p);
+		position_predict.push_back(p);
+		position_reference.push_back(shape.position[k]);
+		offset_reference.push_back(shape.position[k] - deformable.com_reference);
+		// Linear and angular velocity
+		velocity.push_back(linear_velocity + cross(angular_velocity, p-deformable.com));
+		shape_index.push_back(kd);
+		awake.push_back(1.0f);
+	}
+
+	// Precomputation of the moment matrices of the shape matching
+	deformable.initialize_reference(position_reference, offset_reference);
+
+	shapes.push_back(deformable);
+	return shapes.back();
+}
+
+void deformable_world_structure::set_sleeping(int kd, bool sleeping, float margin)
+{
+	shape_deformable_structure& deformable = shapes[kd];
+	if(deformable.sleeping == sleeping)
+		return;
+	deformable.sleeping = sleeping;
+	deformable.calm_steps = 0;
+	for(int k=deformable.offset; k<deformable.offset+deformable.size(); ++k) {
+		awake[k] = sleeping ? 0.0f : 1.0f;
+		if(sleeping) {
+			velocity[k] = {0,0,0};
+			position_predict[k] = position[k];
+		}
+	}
+
+	if(sleeping) {
+		// The shape doesn't move anymore: its box is computed once
+		bounding_box& b = deformable.sleeping_box;
+		b.p_min = b.p_max = position[deformable.offset];
+		for(int k=deformable.offset; k<deformable.offset+deformable.size(); ++k) {
+			vec3 const& p = position[k];
+			b.p_min = { std::min(b.p_min.x, p.x), std::min(b.p_min.y, p.y), std::min(b.p_min.z, p.z) };
+			b.p_max = { std::max(b.p_max.x, p.x), std::max(b.p_max.y, p.y), std::max(b.p_max.z, p.z) };
+		}
+		b.extends(margin);
+
+		for(int kd2=0; kd2<size(); ++kd2) {
+			if(kd2!=kd && shapes[kd2].sleeping && bounding_box::collide(b, shapes[kd2].sleeping_box)) {
+				deformable.sleeping_neighbors.push_back(kd2);
+				shapes[kd2].sleeping_neighbors.push_back(kd);
+			}
+		}
+	}
+	else {
+		for(int kd2 : deformable.sleeping_neighbors) {
+			std::vector<int>& neighbors = shapes[kd2].sleeping_neighbors;
+			neighbors.erase(std::remove(neighbors.begin(), neighbors.end(), kd), neighbors.end());
+		}
+		deformable.sleeping_neighbors.clear();
+	}
+}
+
+int deformable_world_structure::size() const {
+	return shapes.size();
+}
+
+int deformable_world_structure::number_of_particles() const {
+	return position.size();
+}
+
+void deformable_world_structure::update_drawable(float rigid_tolerance) {
+	std::vector<int> updated;
+	for(int kd=0; kd<size(); ++kd)
+		if(!(shapes[kd].sleeping && shapes[kd].drawable_sleeping))
+			updated.push_back(kd);
+
+	// Positions and normals (CPU)
+	int const N_updated = updated.size();
+	#pragma omp parallel for schedule(dynamic)
+	for(int i=0; i<N_updated; ++i)
+		shapes[updated[i]].update_position_and_normal(position, rigid_tolerance);
+
+	// Upload to the GPU (from the thread owning the OpenGL context)
+	for(int kd : updated) {
+		shapes[kd].update_vbo();
+		shapes[kd].drawable_sleeping = shapes[kd].sleeping;
+	}
+}
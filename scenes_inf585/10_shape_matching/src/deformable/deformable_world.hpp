@@ -0,0 +1,52 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+#include "deformable.hpp"
+#include "deformable_clusters.hpp"
+
+// Structure storing all the deformable shapes of the scene
+//  The particles of all the shapes are packed into contiguous arrays (one array per attribute),
+//   the shape kd owning the range [shapes[kd].offset, shapes[kd].offset+shapes[kd].size()[.
+//  The per-particle steps of the simulation (integration, walls, velocity update) are then single loops over all the particles of the scene.
+struct deformable_world_structure {
+
+    // The deformable shapes
+	std::vector<shape_deformable_structure> shapes;
+
+    // Positions of the deformed shapes
+	cgp::numarray<cgp::vec3> position;
+    // Predicted positions of the deformed shapes (used to apply the PPD constraints before updating the velocity)
+	cgp::numarray<cgp::vec3> position_predict;
+    // Positions of the reference shapes
+	cgp::numarray<cgp::vec3> position_reference;
+    // Offsets of the reference positions to the center of mass of their shape, including the plastic deformation (q in the shape matching)
+	cgp::numarray<cgp::vec3> offset_reference;
+    // Velocity of the deformed shapes
+	cgp::numarray<cgp::vec3> velocity;
+    // Index of the shape of each particle
+	cgp::numarray<int> shape_index;
+    // 1 for the particles of the awake shapes, 0 for the sleeping ones (used as a factor of the external forces in the per-particle passes)
+	cgp::numarray<float> awake;
+
+    // Overlapping clusters of particles (region-based shape matching), built on demand by the simulation
+	deformable_clusters_structure clusters;
+
+
+    // Add a new deformable shape from a mesh, with an initial translation and velocity
+    //  Returns the new shape (e.g. to set its texture)
+	shape_deformable_structure& add(cgp::mesh const& shape, cgp::vec3 translation, cgp::vec3 linear_velocity, cgp::vec3 angular_velocity);
+
+    // Put the shape kd to sleep (its velocity is set to zero), or wake it up
+    //  When going to sleep, the bounding box of the shape is stored (extended by margin), and the shape is linked to the sleeping shapes
+    //  whose box overlaps it (sleeping_neighbors). Waking up a shape removes these links (its neighbors are not woken up by this function).
+	void set_sleeping(int kd, bool sleeping, float margin = 0.0f);
+
+    // Number of shapes
+	int size() const;
+    // Number of particles (of all the shapes)
+	int number_of_particles() const;
+
+    // Update the position and normals to the vbo of the drawable of all the shapes (except the sleeping ones already up to date)
+    //  The normals are computed in parallel over the shapes. The normals of the shapes moving rigidly (up to rigid_tolerance) are rotated instead of recomputed.
+	void update_drawable(float rigid_tolerance = 1e-4f);
+};
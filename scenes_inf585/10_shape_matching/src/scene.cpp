@@ -48,16 +48,16 @@ void scene_structure::display_frame()
 
 	// Compute the simulation
 	if(param.time_step>1e-6f){
-		simulation_step(deformables, param);
+		simulation_step(world, param, workspace);
 	}
 
 
 	// Display all the deformable shapes
-	for(int k=0; k<deformables.size(); ++k) {
-		deformables[k].update_drawable();
-		draw(deformables[k].drawable);
+	world.update_drawable();
+	for(int k=0; k<world.size(); ++k) {
+		draw(world.shapes[k].drawable);
 		if(gui.display_wireframe){
-			draw_wireframe(deformables[k].drawable);
+			draw_wireframe(world.shapes[k].drawable);
 		}
 	}
 
@@ -67,12 +67,10 @@ void scene_structure::display_frame()
 
 	// Display the vertices with their colliding spheres (slower the display for many vertices)
 	if(gui.display_collision_sphere){
-		for(int k=0; k<deformables.size(); ++k) {
-			sphere.model.scaling = param.collision_radius;
-			for(int kv=0; kv<deformables[k].position.size(); ++kv) {
-				sphere.model.translation = deformables[k].position[kv];
-				draw(sphere, environment);
-			}
+		sphere.model.scaling = param.collision_radius;
+		for(int kv=0; kv<world.number_of_particles(); ++kv) {
+			sphere.model.translation = world.position[kv];
+			draw(sphere, environment);
 		}
 	}
 
@@ -106,9 +104,19 @@ void scene_structure::display_gui()
 	ImGui::Spacing();
 	ImGui::SliderFloat("Time step", &param.time_step, 0,0.01f,"%.5f",2.0f);
 	ImGui::SliderInt("Collision steps", &param.collision_steps, 1,10);	
+	ImGui::Checkbox("Sleeping shapes at rest", &param.sleeping);
+	ImGui::Checkbox("Bounding box early-out", &param.bounding_box_early_out);
 	ImGui::SliderFloat("Friction with air", &param.friction, 0.001f, 0.1f, "%.4f", 2);
 	ImGui::SliderFloat("Elasticity", &param.elasticity, 0,1);	
 	ImGui::SliderFloat("Plasticity", &param.plasticity, 0,1);	
+	ImGui::Text("Shape matching mode:");
+	int* ptr_shape_matching_mode = reinterpret_cast<int*>(&param.shape_matching_mode);
+	ImGui::RadioButton("Rigid", ptr_shape_matching_mode, shape_matching_rigid); ImGui::SameLine();
+	ImGui::RadioButton("Linear", ptr_shape_matching_mode, shape_matching_linear); ImGui::SameLine();
+	ImGui::RadioButton("Quadratic", ptr_shape_matching_mode, shape_matching_quadratic);
+	ImGui::Checkbox("Clustered shape matching", &param.clustered_shape_matching);
+	if(param.clustered_shape_matching)
+		ImGui::SliderFloat("Cluster size", &param.cluster_size, 0.02f, 0.5f);
 
 	ImGui::Spacing(); ImGui::Spacing(); ImGui::Spacing();
 	ImGui::SliderFloat("Speed new shape",&gui.throwing_speed,0.0f, 40.0f);
@@ -186,18 +194,13 @@ void scene_structure::add_new_deformable_shape(vec3 const& center, vec3 const& v
 	m.centered(); 
 	
 
-	// Create a deformable structure from the mesh
-	shape_deformable_structure deformable;
-	deformable.initialize(m);
-	deformable.set_position_and_velocity(center, velocity, angular_velocity);
+	// Add the new deformable structure created from the mesh
+	shape_deformable_structure& deformable = world.add(m, center, velocity, angular_velocity);
 
 	// Special case for spot: set the texture
 	if(gui.primitive_type==primitive_spot) {
 		deformable.drawable.texture.load_and_initialize_texture_2d_on_gpu(project::path+"assets/spot_texture.png");
 	}
-
-	// Add the new deformable structure
-	deformables.push_back(deformable);
 }
 
 void scene_structure::mouse_move_event()
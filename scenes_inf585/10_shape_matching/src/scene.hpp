@@ -4,7 +4,7 @@
 #include "cgp/cgp.hpp"
 #include "environment.hpp"
 #include "simulation/simulation.hpp"
-#include "deformable/deformable.hpp"
+#include "deformable/deformable_world.hpp"
 
 using cgp::mesh_drawable;
 
@@ -43,7 +43,8 @@ struct scene_structure : scene_inputs_generic {
 	cgp::timer_basic timer;
 
 	simulation_parameter param;
-	std::vector<shape_deformable_structure> deformables;
+	deformable_world_structure world; // All the deformable shapes (and their particles)
+	simulation_workspace_structure workspace; // Buffers of the simulation kept between the time steps
 	void add_new_deformable_shape(vec3 const& center, vec3 const& velocity, vec3 const& angular_velocity, vec3 const& color);
 
 	mesh_drawable sphere;
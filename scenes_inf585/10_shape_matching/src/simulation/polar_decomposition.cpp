@@ -0,0 +1,77 @@
+#include "polar_decomposition.hpp"
+
+using namespace cgp;
+
+
+// Rotation of angle theta around the unit axis u (Rodrigues formula)
+static mat3 rotation_axis_angle(vec3 const& u, float theta)
+{
+    float const c = std::cos(theta);
+    float const s = std::sin(theta);
+    float const t = 1.0f - c;
+    return {
+        c + t * u.x * u.x,       t * u.x * u.y - s * u.z, t * u.x * u.z + s * u.y,
+        t * u.y * u.x + s * u.z, c + t * u.y * u.y,       t * u.y * u.z - s * u.x,
+        t * u.z * u.x - s * u.y, t * u.z * u.y + s * u.x, c + t * u.z * u.z };
+}
+
+// Re-orthonormalize R (Gram-Schmidt on its columns) to avoid the accumulation of rounding errors across the frames
+static void orthonormalize(mat3& R)
+{
+    vec3 c0 = { R(0, 0), R(1, 0), R(2, 0) };
+    vec3 c1 = { R(0, 1), R(1, 1), R(2, 1) };
+    c0 = normalize(c0);
+    c1 = normalize(c1 - dot(c0, c1) * c0);
+    vec3 const c2 = cross(c0, c1);
+    R = { c0.x, c1.x, c2.x,
+          c0.y, c1.y, c2.y,
+          c0.z, c1.z, c2.z };
+}
+
+void polar_rotation(mat3 const& M, mat3& R, int max_iterations, float tolerance)
+{
+    // R maximizes tr(R^T M). Each iteration rotates R by a rotation vector phi expressed in the frame of R: R <- R exp([phi])
+    //  With X = R^T M, the second order expansion of tr((R exp([phi]))^T M) is: tr(X) + phi.g - 1/2 phi^T H phi
+    //   with g = (X_21-X_12, X_02-X_20, X_10-X_01) and H = tr(Xs) Id - Xs, Xs being the symmetric part of X.
+    //  - Near the solution, X is close to the symmetric matrix S and H is positive definite: the Newton step phi = H^{-1} g converges quadratically.
+    //  - Otherwise (far from the solution, or inverted shape) the step of Muller et al. is used: phi = g/|tr(X)|, which always converges.
+    for (int k = 0; k < max_iterations; ++k) {
+        mat3 const X = transpose(R) * M;
+        vec3 const g = { X(2, 1) - X(1, 2), X(0, 2) - X(2, 0), X(1, 0) - X(0, 1) };
+        float const trace = X(0, 0) + X(1, 1) + X(2, 2);
+
+        // H = tr(X) Id - Xs
+        float const h00 = trace - X(0, 0), h11 = trace - X(1, 1), h22 = trace - X(2, 2);
+        float const h01 = -0.5f * (X(0, 1) + X(1, 0));
+        float const h02 = -0.5f * (X(0, 2) + X(2, 0));
+        float const h12 = -0.5f * (X(1, 2) + X(2, 1));
+        float const c00 = h11 * h22 - h12 * h12;
+        float const c01 = h02 * h12 - h01 * h22;
+        float const c02 = h01 * h12 - h02 * h11;
+        float const det_h = h00 * c00 + h01 * c01 + h02 * c02;
+
+        vec3 phi;
+        bool const positive_definite = h00 > 0 && (h00 * h11 - h01 * h01) > 0 && det_h > 1e-6f * std::abs(trace * trace * trace);
+        if (positive_definite) {
+            float const c11 = h00 * h22 - h02 * h02;
+            float const c12 = h01 * h02 - h00 * h12;
+            float const c22 = h00 * h11 - h01 * h01;
+            phi = vec3(c00 * g.x + c01 * g.y + c02 * g.z, c01 * g.x + c11 * g.y + c12 * g.z, c02 * g.x + c12 * g.y + c22 * g.z) / det_h;
+        }
+        else
+            phi = g / (std::abs(trace) + 1e-9f);
+
+        float const w = norm(phi);
+        if (w < tolerance)
+            break;
+        R = R * rotation_axis_angle(phi / w, std::min(w, 1.0f));
+    }
+    orthonormalize(R);
+}
+
+void polar_rotation(mat3 const* M, mat3* R, int N, int max_iterations, float tolerance)
+{
+    #pragma omp parallel for schedule(static)
+    for (int k = 0; k < N; ++k)
+        polar_rotation(M[k], R[k], max_iterations, tolerance);
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+
+
+// Rotation part R of the polar decomposition M = R S of a 3x3 matrix (S symmetric positive semi-definite)
+//  Iterative maximization of tr(R^T M) over the rotations, in the spirit of [Muller et al. 2016, A Robust Method to Extract the Rotational Part of Deformations]:
+//   R is successively rotated around the axis that best aligns its columns with the columns of M (Newton step near the solution, Muller step otherwise).
+//  - R is used as initial guess and is updated in place. Starting from the rotation of the previous step, 1 or 2 iterations are usually enough.
+//  - The result is always a rotation (det(R)=1), including for degenerated (flat, or inverted) matrices M.
+//  - Only a few multiplications and one sin/cos per iteration: much faster than a full SVD.
+void polar_rotation(cgp::mat3 const& M, cgp::mat3& R, int max_iterations = 20, float tolerance = 1e-6f);
+
+// Batched version over N matrices (computed in parallel)
+void polar_rotation(cgp::mat3 const* M, cgp::mat3* R, int N, int max_iterations = 20, float tolerance = 1e-6f);
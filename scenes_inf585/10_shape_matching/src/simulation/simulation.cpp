@@ -1,4 +1,8 @@
 #include "simulation.hpp"
+#include "polar_decomposition.hpp"
+#include "spatial_hash.hpp"
+#include <limits>
+#include <algorithm>
 #include "../../third_party/eigen/Eigen/Core"
 #include "../../third_party/eigen/Eigen/SVD"
 
@@ -6,42 +10,69 @@
 
 using namespace cgp;
 
+// Frobenius norm of a matrix
+static float frobenius_norm(mat3 const& X)
+{
+    float n2 = 0;
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 3; ++j)
+            n2 += X(i,j) * X(i,j);
+    return std::sqrt(n2);
+}
+
 // Compute the polar decomposition of the matrix M and return the rotation such that
 //   M = R * S, where R is a rotation matrix and S is a positive semi-definite matrix
+//  Reference implementation using a full SVD: the simulation uses the faster iterative polar_rotation (see polar_decomposition.hpp)
 mat3 polar_decomposition(mat3 const& M);
 
 // Compute the collision between the particles and the walls
-void collision_with_walls(std::vector<shape_deformable_structure>& deformables);
+void collision_with_walls(deformable_world_structure& world);
 
 // Compute the collision between the particles to each other
-void collision_between_particles(std::vector<shape_deformable_structure>& deformables, simulation_parameter const& param);
+void collision_between_particles(deformable_world_structure& world, simulation_parameter const& param, simulation_workspace_structure& workspace);
 
 // Compute the shape matching on all the deformable shapes
-void shape_matching(std::vector<shape_deformable_structure>& deformables, simulation_parameter const& param);
+//  update_plasticity: update the plastic deformation of the reference shapes (done once per time step)
+void shape_matching(deformable_world_structure& world, simulation_parameter const& param, simulation_workspace_structure& workspace, bool update_plasticity);
+
+// Compute the region-based shape matching on all the deformable shapes (overlapping clusters)
+void shape_matching_clusters(deformable_world_structure& world, simulation_parameter const& param, simulation_workspace_structure& workspace);
+
+// Update the plastic deformation of the reference shape from the linear deformation A = A_pq A_qq of the shape
+void plastic_update(deformable_world_structure& world, int kd, mat3 const& A, simulation_parameter const& param);
 
 
 
 
+// Update the sleeping state of the shapes from their kinetic energy
+void update_sleeping(deformable_world_structure& world, simulation_parameter const& param);
+
 // Perform one simulation step (one numerical integration along the time step dt) using PPD + Shape Matching
-void simulation_step(std::vector<shape_deformable_structure>& deformables, simulation_parameter const& param)
+//  The per-particle steps are single passes over the particles of all the shapes (see deformable_world_structure),
+//  split between the threads. The shape matching is parallel over the shapes, and the collisions parallel over the spatial cells.
+//  The sleeping shapes have a zero velocity and no external force (awake=0): they stay in place during the per-particle passes,
+//  and are skipped by the shape matching and the collisions.
+void simulation_step(deformable_world_structure& world, simulation_parameter const& param, simulation_workspace_structure& workspace)
 {
-    float dt = param.time_step;
-    int N_deformable = deformables.size();
+    float const dt = param.time_step;
+    int const N = world.number_of_particles();
+    vec3* position = world.position.data.data();
+    vec3* position_predict = world.position_predict.data.data();
+    vec3* velocity = world.velocity.data.data();
+    float const* awake = world.awake.data.data();
 
     // I. - Apply the external forces to the velocity
     //    - Compute the predicted position from this time integration
     vec3 const gravity = vec3(0.0f, 0.0f, -9.81f);
-    for(int kd=0; kd<N_deformable; ++kd) { // For all the deformable shapes
-        shape_deformable_structure& deformable = deformables[kd];
-        int N_vertex = deformable.position.size();
-        for(int k=0; k<N_vertex; ++k) // For all the vertices of each deformable shape
-        {
-            // Standard integration of external forces
-            //   drag + gravity
-            deformable.velocity[k] = deformable.velocity[k]*(1-dt*param.friction) + dt*gravity;  
-            //   predicted position
-            deformable.position_predict[k] = deformable.position[k] + dt*deformable.velocity[k]; 
-        }
+    float const damping = 1-dt*param.friction;
+    #pragma omp parallel for simd schedule(static)
+    for(int k=0; k<N; ++k) // For all the vertices of all the deformable shapes
+    {
+        // Standard integration of external forces
+        //   drag + gravity
+        velocity[k] = velocity[k]*damping + (dt*awake[k])*gravity;
+        //   predicted position
+        position_predict[k] = position[k] + dt*velocity[k];
     }
 
     // II. Constraints using PPD
@@ -51,129 +82,480 @@ void simulation_step(std::vector<shape_deformable_structure>& deformables, simul
     // Note: The parameter collision_steps can be modified by the gui interface
     for(int k_collision_steps=0; k_collision_steps<param.collision_steps; ++k_collision_steps){
 
-        collision_with_walls(deformables);
-        collision_between_particles(deformables, param);
-        shape_matching(deformables, param);
+        collision_with_walls(world);
+        collision_between_particles(world, param, workspace);
+        shape_matching(world, param, workspace, k_collision_steps==param.collision_steps-1);
 
     }
 
 
     // III. Final velocity update
-    for(int kd=0; kd<N_deformable; ++kd) 
+    float const inv_dt = 1/dt;
+    #pragma omp parallel for simd schedule(static)
+    for(int k=0; k<N; ++k)
     {
-        shape_deformable_structure& deformable = deformables[kd];
+        // Update velocity
+        velocity[k] = (position_predict[k]-position[k])*inv_dt;
 
-        for(int k=0; k<deformable.size(); ++k)
-        {
-            // Update velocity
-            deformable.velocity[k] = (deformable.position_predict[k]-deformable.position[k])/dt;
-
-            // Update the vertex position
-            deformable.position[k] = deformable.position_predict[k];
-        }
+        // Update the vertex position
+        position[k] = position_predict[k];
     }
+
+    // IV. Shapes at rest go to sleep
+    update_sleeping(world, param);
 	
 }
 
 
 // Compute the shape matching on all the deformable shapes
-void shape_matching(std::vector<shape_deformable_structure>& deformables, simulation_parameter const& param)
+void shape_matching(deformable_world_structure& world, simulation_parameter const& param, simulation_workspace_structure& workspace, bool update_plasticity)
 {
-    // Arguments:
-    //   deformables: stores a vector of all the deformable shape
-    //   Each deformable shape structure contains 
-    //        - the predicted position [deformable].position_predicted
-    //        - the center of mass [deformable].com
-    //        - the reference position [deformable].position_reference
-    //        - the center of mass from the reference position [deformable].com_reference
-
-
-    // ********************************************** //
-    // TO DO: Implement here the Shape Matching
-    // ********************************************** //
-
-    // Algorithm:
-    //   - For all deformable shapes
-    //     - Update the com (center of mass) from the predicted position
-    //     - Compute the best rotation R such that p_predicter - com = R (p_reference-com_reference)
-    //        - Compute the matrix M = \sum r r_ref^T
-    //            with r  = p_predicted - com
-    //                 r_ref = p_reference - com_reference
-    //        - Compute R as the polar decomposition of M
-    //     - Set the new predicted position as p_predicted = R (p_reference-com_reference) + com
-    // 
-    //
-    // Help:
-    //   - A function "mat3 polar_decomposition(mat3 const& M)" that computes the polar decomposition using SVD is provided.
-    //  - The center of mass of the predicted position can be computed as "average(deformable.position_predicted)"
-    //  - A matrix mat3 can be initialized to zeros with the syntax "mat3 M = mat3::build_zero();"
-    //  - The product a * b^tr, where (a,b) are vec3 is also called a tensor product. It can be computed using the syntax "mat3 M = tensor_product(a,b)"
+    // For all deformable shapes
+    //  - Update the com (center of mass) from the predicted position
+    //  - Compute the best rotation R such that p_predicted - com = R q
+    //     with q = p_reference - com_reference (precomputed in offset_reference)
+    //     - Compute the matrix A_pq = \sum r q^T
+    //         with r  = p_predicted - com
+    //     - Compute R as the polar decomposition of A_pq
+    //  - Set the new predicted position as p_predicted = G q + com, with the goal transformation G depending on the mode
+    //     - rigid: G = R
+    //     - linear: G = beta A + (1-beta) R, with A = A_pq A_qq the best linear transformation (normalized to preserve the volume)
+    //     - quadratic: G = beta A~ + (1-beta) [R 0 0] applied to the quadratic terms q~, with A~ = A~_pq A~_qq
+    //    The moment matrices A_qq are precomputed for each shape (see shape_deformable_structure).
     //
+    // The rotations of all the shapes are extracted together (batched polar decomposition),
+    //  each one starting from the rotation found at the previous step for the same shape.
+    if (param.clustered_shape_matching) {
+        shape_matching_clusters(world, param, workspace);
+        return;
+    }
+
+    int const N_deformable = world.size();
+    vec3* position_predict = world.position_predict.data.data();
+    vec3 const* offset_reference = world.offset_reference.data.data();
+    bool const quadratic = param.shape_matching_mode==shape_matching_quadratic;
+    float const beta = param.elasticity;
+
+    std::vector<mat3>& M = workspace.M; // Matrices A_pq of the shapes
+    std::vector<mat3>& R = workspace.R; // Rotations of the shapes
+    std::vector<Eigen::Matrix<float,3,9>>& A_quadratic = workspace.A_quadratic; // Quadratic transformations A~ of the shapes
+    M.resize(N_deformable);
+    R.resize(N_deformable);
+    if (quadratic)
+        A_quadratic.resize(N_deformable);
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int kd = 0; kd < N_deformable; ++kd) {
+        shape_deformable_structure& deformable = world.shapes[kd];
+        int const k0 = deformable.offset;
+        int const k1 = deformable.offset + deformable.size();
+
+        // Sleeping shape: M=R gives immediately R in the polar decomposition
+        if (deformable.sleeping) {
+            M[kd] = R[kd] = deformable.rotation;
+            continue;
+        }
+
+        vec3 com = { 0,0,0 };
+        for (int k = k0; k < k1; ++k)
+            com += position_predict[k];
+        deformable.com = com / float(k1 - k0);
+
+        mat3 Md = mat3::build_zero();
+        for (int k = k0; k < k1; ++k)
+            Md += tensor_product(position_predict[k] - deformable.com, offset_reference[k]);
+        M[kd] = Md;
+        R[kd] = deformable.rotation;
+
+        if (quadratic) {
+            Eigen::Matrix<float,3,9> Apq = Eigen::Matrix<float,3,9>::Zero();
+            for (int k = k0; k < k1; ++k) {
+                vec3 const r = position_predict[k] - deformable.com;
+                Apq += Eigen::Vector3f(r.x, r.y, r.z) * quadratic_terms(offset_reference[k]).transpose();
+            }
+            A_quadratic[kd] = Apq * deformable.A_qq_quadratic;
+        }
+    }
 
+    polar_rotation(M.data(), R.data(), N_deformable);
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int kd = 0; kd < N_deformable; ++kd) {
+        shape_deformable_structure& deformable = world.shapes[kd];
+        int const k0 = deformable.offset;
+        int const k1 = deformable.offset + deformable.size();
+        if (deformable.sleeping)
+            continue;
+        mat3 const& Rd = R[kd];
+        deformable.rotation = Rd;
+
+        // Best linear transformation of the reference shape
+        mat3 const A = M[kd] * deformable.A_qq;
+
+        // The distance between the goal positions and the rigid ones R q + com is bounded by |G-R| max|q~| (used to display the shape)
+        if (param.shape_matching_mode==shape_matching_rigid) {
+            for (int k = k0; k < k1; ++k)
+                position_predict[k] = Rd * offset_reference[k] + deformable.com;
+            deformable.rigid_residual = 0.0f;
+        }
+        else if (param.shape_matching_mode==shape_matching_linear) {
+            // Volume preservation: det(A)=1 (flat or inverted configurations fall back to the rotation)
+            float const det_A = det(A);
+            mat3 const A_volume = det_A > 1e-6f ? (1/std::cbrt(det_A)) * A : Rd;
+            mat3 const G = beta * A_volume + (1 - beta) * Rd;
+            for (int k = k0; k < k1; ++k)
+                position_predict[k] = G * offset_reference[k] + deformable.com;
+            deformable.rigid_residual = frobenius_norm(G - Rd) * deformable.reference_radius;
+        }
+        else {
+            Eigen::Matrix<float,3,9> G = beta * A_quadratic[kd];
+            for (int i = 0; i < 3; ++i)
+                for (int j = 0; j < 3; ++j)
+                    G(i,j) += (1 - beta) * Rd(i,j);
+            for (int k = k0; k < k1; ++k) {
+                Eigen::Vector3f const g = G * quadratic_terms(offset_reference[k]);
+                position_predict[k] = vec3(g.x(), g.y(), g.z()) + deformable.com;
+            }
+            // G - [R 0 0] = beta (A~ - [R 0 0])
+            Eigen::Matrix<float,3,9> D = A_quadratic[kd];
+            for (int i = 0; i < 3; ++i)
+                for (int j = 0; j < 3; ++j)
+                    D(i,j) -= Rd(i,j);
+            deformable.rigid_residual = beta * D.norm() * deformable.reference_radius;
+        }
+
+        if (update_plasticity && param.plasticity > 0)
+            plastic_update(world, kd, A, param);
+    }
 }
 
+// Region-based shape matching [Muller et al. 2005, Sec 4.5]
+//  The same computation as the shape matching is applied to each cluster c (see deformable_clusters_structure):
+//   com_c, A_pq,c = \sum (p-com_c)(q-q_c)^T, R_c = polar(A_pq,c), and goal transformation G_c (rigid, or linear)
+//  and the goal position of a particle is the average of the goals given by its clusters: p = 1/N_c \sum_c G_c (q-q_c) + com_c
+//  Each particle belongs to a bounded number of clusters: the cost per particle doesn't depend on the resolution of the mesh.
+//  The quadratic mode is matched as the linear one on the clusters (bending is obtained from the relative rotations of the clusters).
+//  The plasticity is not applied in this mode.
+void shape_matching_clusters(deformable_world_structure& world, simulation_parameter const& param, simulation_workspace_structure& workspace)
+{
+    deformable_clusters_structure& clusters = world.clusters;
+    clusters.update(world.shapes, world.offset_reference, param.cluster_size);
+
+    int const N_cluster = clusters.size();
+    int const N = world.number_of_particles();
+    vec3* position_predict = world.position_predict.data.data();
+    vec3 const* offset_reference = world.offset_reference.data.data();
+    float const beta = param.elasticity;
+
+    std::vector<vec3>& com = workspace.cluster_com; // Centers of mass of the clusters
+    std::vector<mat3>& M = workspace.cluster_M;     // Matrices A_pq of the clusters
+    std::vector<mat3>& G = workspace.cluster_G;     // Goal transformations of the clusters
+    com.resize(N_cluster);
+    M.resize(N_cluster);
+    G.resize(N_cluster);
+
+    #pragma omp parallel for schedule(dynamic,64)
+    for (int c = 0; c < N_cluster; ++c) {
+        int const i0 = clusters.start[c];
+        int const i1 = clusters.start[c + 1];
+
+        // Cluster of a sleeping shape: M=R gives immediately R in the polar decomposition
+        if (world.awake[clusters.particles[i0]] == 0) {
+            M[c] = clusters.rotation[c];
+            continue;
+        }
+
+        vec3 com_c = { 0,0,0 };
+        for (int i = i0; i < i1; ++i)
+            com_c += position_predict[clusters.particles[i]];
+        com_c /= float(i1 - i0);
 
+        mat3 Mc = mat3::build_zero();
+        for (int i = i0; i < i1; ++i) {
+            int const k = clusters.particles[i];
+            Mc += tensor_product(position_predict[k] - com_c, offset_reference[k] - clusters.com_reference[c]);
+        }
+        com[c] = com_c;
+        M[c] = Mc;
+    }
 
+    polar_rotation(M.data(), clusters.rotation.data(), N_cluster);
+
+    #pragma omp parallel for schedule(static)
+    for (int c = 0; c < N_cluster; ++c) {
+        mat3 const& Rc = clusters.rotation[c];
+        G[c] = Rc;
+        if (param.shape_matching_mode != shape_matching_rigid) {
+            mat3 const A = M[c] * clusters.A_qq[c];
+            float const det_A = det(A);
+            if (det_A > 1e-6f)
+                G[c] = beta * ((1/std::cbrt(det_A)) * A) + (1 - beta) * Rc;
+        }
+    }
 
-void collision_between_particles(std::vector<shape_deformable_structure>& deformables, simulation_parameter const& param)
+    // Blend the goal positions of the clusters of each particle
+    #pragma omp parallel for schedule(static)
+    for (int k = 0; k < N; ++k) {
+        if (world.awake[k] == 0)
+            continue;
+        int const j0 = clusters.particle_start[k];
+        int const j1 = clusters.particle_start[k + 1];
+        vec3 goal = { 0,0,0 };
+        for (int j = j0; j < j1; ++j) {
+            int const c = clusters.particle_clusters[j];
+            goal += G[c] * (offset_reference[k] - clusters.com_reference[c]) + com[c];
+        }
+        position_predict[k] = goal / float(j1 - j0);
+    }
+
+    // Center of mass of the shapes
+    //  (the shapes are not matched by a single rotation anymore: their normals are always recomputed for the display)
+    #pragma omp parallel for schedule(dynamic)
+    for (int kd = 0; kd < world.size(); ++kd) {
+        shape_deformable_structure& deformable = world.shapes[kd];
+        if (deformable.sleeping)
+            continue;
+        deformable.rigid_residual = std::numeric_limits<float>::max();
+        vec3 com_d = { 0,0,0 };
+        for (int k = deformable.offset; k < deformable.offset + deformable.size(); ++k)
+            com_d += position_predict[k];
+        deformable.com = com_d / float(deformable.size());
+    }
+}
+
+// Update the plastic deformation of the reference shape [Muller et al. 2005, Sec 4.4]
+//  The deformation of the shape in its reference frame S = R^T A (symmetric part) is partially transferred to the plastic deformation Sp
+//  when it exceeds the yield value: Sp <- (Id + plasticity (S-Id)) Sp, with |Sp-Id| bounded and det(Sp)=1.
+//  The reference offsets and moment matrices of the shape are then updated incrementally (see set_plastic_deformation).
+void plastic_update(deformable_world_structure& world, int kd, mat3 const& A, simulation_parameter const& param)
+{
+    shape_deformable_structure& deformable = world.shapes[kd];
+    mat3 const Id = mat3::build_identity();
+
+    mat3 const RtA = transpose(deformable.rotation) * A;
+    mat3 const S = 0.5f * (RtA + transpose(RtA));
+
+    if (frobenius_norm(S - Id) <= param.plasticity_yield)
+        return;
+
+    mat3 Sp = (Id + param.plasticity * (S - Id)) * deformable.plastic_deformation;
+    float const plastic_norm = frobenius_norm(Sp - Id);
+    if (plastic_norm > param.plasticity_max)
+        Sp = Id + (param.plasticity_max / plastic_norm) * (Sp - Id);
+
+    float const det_Sp = det(Sp);
+    if (det_Sp < 1e-3f)
+        return;
+    Sp = (1/std::cbrt(det_Sp)) * Sp;
+
+    deformable.set_plastic_deformation(Sp, world.position_reference, world.offset_reference);
+}
+
+
+
+
+void collision_between_particles(deformable_world_structure& world, simulation_parameter const& param, simulation_workspace_structure& workspace)
 {
     float r = param.collision_radius; // radius of colliding sphere
+    int N_deformable = world.size();
+    vec3* position_predict = world.position_predict.data.data();
+
+    // Optional early-out using axis-aligned bounding boxes:
+    //  only the particles of the shapes whose bounding box collides with the one of another shape can collide
+    //  (the boxes of the sleeping shapes are the ones stored when they went to sleep)
+    std::vector<char> candidate(N_deformable, param.bounding_box_early_out ? 0 : 1);
+    std::vector<bounding_box>& bbox = workspace.bbox;
+    if (param.bounding_box_early_out) {
+        bbox.resize(N_deformable);
+        #pragma omp parallel for schedule(static)
+        for(int kd=0; kd<N_deformable; ++kd) {
+            shape_deformable_structure const& deformable = world.shapes[kd];
+            bounding_box& b = bbox[kd];
+            if(deformable.sleeping) {
+                b = deformable.sleeping_box;
+                continue;
+            }
+            b.p_min = b.p_max = position_predict[deformable.offset];
+            for(int k=deformable.offset; k<deformable.offset+deformable.size(); ++k) {
+                vec3 const& p = position_predict[k];
+                b.p_min = { std::min(b.p_min.x, p.x), std::min(b.p_min.y, p.y), std::min(b.p_min.z, p.z) };
+                b.p_max = { std::max(b.p_max.x, p.x), std::max(b.p_max.y, p.y), std::max(b.p_max.z, p.z) };
+            }
+            b.extends(r);
+        }
+
+        // Sweep and prune along x: the boxes are sorted by their lower x bound, and each box is only tested against
+        //  the following ones starting before its upper x bound (instead of all the other shapes).
+        //  Two sleeping shapes don't need to be tested against each other.
+        std::vector<int> order(N_deformable);
+        for(int kd=0; kd<N_deformable; ++kd)
+            order[kd] = kd;
+        std::sort(order.begin(), order.end(), [&bbox](int a, int b) { return bbox[a].p_min.x < bbox[b].p_min.x || (bbox[a].p_min.x == bbox[b].p_min.x && a < b); });
+
+        for(int a=0; a<N_deformable; ++a) {
+            int const kd = order[a];
+            for(int b=a+1; b<N_deformable && bbox[order[b]].p_min.x <= bbox[kd].p_max.x; ++b) {
+                int const kd2 = order[b];
+                bool const both_sleeping = world.shapes[kd].sleeping && world.shapes[kd2].sleeping;
+                if(!both_sleeping && bounding_box::collide(bbox[kd], bbox[kd2]))
+                    candidate[kd] = candidate[kd2] = 1;
+            }
+        }
+    }
 
-    // Prepare acceleration structure using axis-aligned bounding boxes.
-    std::vector<bounding_box> bbox;
-    int N_deformable = deformables.size();
+    // Gather the particles of the candidate shapes
+    std::vector<vec3>& position = workspace.position;            // predicted position of the particle
+    std::vector<int>& shape_index = workspace.shape_index;       // index of its deformable shape
+    std::vector<int>& particle_index = workspace.particle_index; // index of the particle in the world arrays
+    std::vector<int> gather_offset(N_deformable+1, 0); // first index of the particles of each shape in the gathered arrays
+    for(int kd=0; kd<N_deformable; ++kd)
+        gather_offset[kd+1] = gather_offset[kd] + (candidate[kd] ? world.shapes[kd].size() : 0);
+    int const N = gather_offset[N_deformable];
+    if(N==0)
+        return;
+    position.resize(N); shape_index.resize(N); particle_index.resize(N);
+
+    #pragma omp parallel for schedule(dynamic)
     for(int kd=0; kd<N_deformable; ++kd) {
-        bounding_box b;
-        b.initialize(deformables[kd].position_predict);
-        b.extends(r);
-        bbox.push_back(b);
+        if(!candidate[kd])
+            continue;
+        shape_deformable_structure const& deformable = world.shapes[kd];
+        for(int k=0; k<deformable.size(); ++k) {
+            int const i = gather_offset[kd] + k;
+            position[i] = position_predict[deformable.offset+k];
+            shape_index[i] = kd;
+            particle_index[i] = deformable.offset+k;
+        }
     }
-    // Can test if two bounding box (bbox1,bbox2) collide using
-    //   bool is_in_collision = bounding_box::collide(bbox1, bbox2);
-    // These bounding box are an optional possibility to accelerate the computation to avoid checking pairwise collisions between particles of shapes that are far away.
 
+    // Broadphase: spatial hash with cells of size 2r, giving the pairs of particles of different shapes closer than 2r
+    spatial_hash_structure& spatial_hash = workspace.spatial_hash;
+    std::vector<int2>& pairs = workspace.pairs;
+    std::vector<int2>& sorted_pairs = workspace.sorted_pairs;
+    std::vector<int>& batch_start = workspace.batch_start;
+    spatial_hash.build(position, 2*r);
+    spatial_hash.find_pairs(position, shape_index, 2*r, pairs);
+
+    // Remove the collision state of each pair: the two particles are moved apart symmetrically
+    //  The pairs are processed by color: the batches of a same color don't share any particle and are processed in parallel.
+    //  Within a batch the pairs are processed sequentially in a fixed order: the result doesn't depend on the number of threads.
+    spatial_hash.sort_pairs_by_color(position, pairs, sorted_pairs, batch_start);
+    //  A sleeping shape colliding with a moving shape is woken up.
+    int const N_bucket = spatial_hash.number_of_buckets();
+    std::vector<char> wake_up(N_deformable, 0);
+    for(int color=0; color<8; ++color) {
+        #pragma omp parallel for schedule(dynamic,256)
+        for(int b=0; b<N_bucket; ++b) {
+            int const batch = color*N_bucket + b;
+            for(int k=batch_start[batch]; k<batch_start[batch+1]; ++k) {
+                int const si = shape_index[sorted_pairs[k].x];
+                int const sj = shape_index[sorted_pairs[k].y];
+                bool const sleeping_i = world.shapes[si].sleeping;
+                bool const sleeping_j = world.shapes[sj].sleeping;
+                if(sleeping_i && sleeping_j)
+                    continue;
+
+                // A calm shape (kinetic energy below the threshold at the last step) in contact with a sleeping one doesn't wake it up:
+                //  the sleeping shape is a static obstacle. Otherwise the sleeping shape is woken up.
+                float wi = 0.5f, wj = 0.5f; // part of the correction applied to each particle
+                if(sleeping_i || sleeping_j) {
+                    int const s_sleeping = sleeping_i ? si : sj;
+                    int const s_awake = sleeping_i ? sj : si;
+                    if(world.shapes[s_awake].calm_steps==0) {
+                        #pragma omp atomic write
+                        wake_up[s_sleeping] = 1;
+                    }
+                    else {
+                        wi = sleeping_i ? 0.0f : 1.0f;
+                        wj = 1.0f - wi;
+                    }
+                }
+
+                vec3& pi = position_predict[particle_index[sorted_pairs[k].x]];
+                vec3& pj = position_predict[particle_index[sorted_pairs[k].y]];
+                vec3 const u = pj-pi;
+                float const d = norm(u);
+                if(d<2*r && d>1e-6f) {
+                    vec3 const delta = ((2*r-d)/d) * u;
+                    pi -= wi * delta;
+                    pj += wj * delta;
+                }
+            }
+        }
+    }
+
+    // Wake up the shapes, and the islands of sleeping shapes in contact with them (propagated through the sleeping neighbors)
+    std::vector<int> woken;
+    for(int kd=0; kd<N_deformable; ++kd)
+        if(wake_up[kd])
+            woken.push_back(kd);
+    while(!woken.empty()) {
+        int const kd = woken.back();
+        woken.pop_back();
+        if(!world.shapes[kd].sleeping)
+            continue;
+        woken.insert(woken.end(), world.shapes[kd].sleeping_neighbors.begin(), world.shapes[kd].sleeping_neighbors.end());
+        world.set_sleeping(kd, false);
+    }
+}
+
+// Update the sleeping state of the shapes from their kinetic energy
+//  A shape sleeps once its kinetic energy per particle stayed below param.sleep_energy during param.sleep_steps time steps
+void update_sleeping(deformable_world_structure& world, simulation_parameter const& param)
+{
+    int const N_deformable = world.size();
+    vec3 const* velocity = world.velocity.data.data();
 
-    // ********************************************** //
-    // TO DO: Implement here the collision between particles from different deformable shapes
-    // ********************************************** //
+    #pragma omp parallel for schedule(dynamic)
+    for(int kd=0; kd<N_deformable; ++kd) {
+        shape_deformable_structure& deformable = world.shapes[kd];
+        if(deformable.sleeping)
+            continue;
 
-    // Algorithm:
-    //  - For all the deformable shapes (d_i,d_j)
-    //    - For all the vertices(/particles) of the shapes (p_i,p_j)
-    //      - If ||p_i-p_j|| < 2 r // collision state
-    //           Then modify (p_i,p_j) to remove the collision state
+        float energy = 0.0f;
+        for(int k=deformable.offset; k<deformable.offset+deformable.size(); ++k)
+            energy += 0.5f * dot(velocity[k], velocity[k]);
+        energy /= float(deformable.size());
 
+        deformable.calm_steps = (energy < param.sleep_energy) ? deformable.calm_steps+1 : 0;
+    }
+
+    // The changes of state link/unlink the neighboring sleeping shapes: they are applied sequentially, in the order of the shapes
+    for(int kd=0; kd<N_deformable; ++kd) {
+        shape_deformable_structure const& deformable = world.shapes[kd];
+        if(!param.sleeping && deformable.sleeping)
+            world.set_sleeping(kd, false);
+        else if(param.sleeping && !deformable.sleeping && deformable.calm_steps >= param.sleep_steps)
+            world.set_sleeping(kd, true, param.collision_radius);
+    }
 }
 
 
 // Compute the collision between the particles and the walls
 // Note: This function is already pre-coded
-void collision_with_walls(std::vector<shape_deformable_structure>& deformables)
+//  Single branch-free pass over the particles of all the shapes (vectorized)
+void collision_with_walls(deformable_world_structure& world)
 {
-    int N_deformable = deformables.size();
-    for(int kd=0; kd<N_deformable; ++kd) {
-        shape_deformable_structure& deformable = deformables[kd];
-        int N_vertex = deformable.size();
-        for(int k=0; k<N_vertex; ++k)
-        {
-            vec3& p = deformable.position_predict[k];
-            
-            // Standard collision with the walls in x and y. 
-            //  Modify these values for different parameters
-            if(p.x<-1) p.x = -1;
-            if(p.x>5)  p.x = 5;
-            if(p.y<-1) p.y = -1;
-            if(p.y>5)  p.y = 5;
-
-            // Collision with the ground
-            if(p.z<0) {
-                p.z = 0;
-                // model friction with the ground
-                p.x = deformable.position[k].x;
-                p.y = deformable.position[k].y;
-            }
+    int const N = world.number_of_particles();
+    vec3 const* position = world.position.data.data();
+    vec3* position_predict = world.position_predict.data.data();
 
-         }
+    #pragma omp parallel for simd schedule(static)
+    for(int k=0; k<N; ++k)
+    {
+        vec3& p = position_predict[k];
+
+        // Standard collision with the walls in x and y. 
+        //  Modify these values for different parameters
+        p.x = std::min(std::max(p.x, -1.0f), 5.0f);
+        p.y = std::min(std::max(p.y, -1.0f), 5.0f);
+
+        // Collision with the ground
+        bool const ground = p.z<0;
+        p.z = ground ? 0.0f : p.z;
+        // model friction with the ground
+        p.x = ground ? position[k].x : p.x;
+        p.y = ground ? position[k].y : p.y;
     }
 }
 
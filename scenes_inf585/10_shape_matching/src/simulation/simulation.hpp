@@ -1,4 +1,11 @@
-#include "../deformable/deformable.hpp"
+#include "../deformable/deformable_world.hpp"
+#include "spatial_hash.hpp"
+
+// Deformation modes of the shape matching [Muller et al. 2005, Meshless Deformations Based on Shape Matching]
+//  - rigid: the goal positions are a rotation of the reference shape
+//  - linear: the goal positions also follow the linear deformation (shear and stretch) of the shape
+//  - quadratic: the goal positions also follow its quadratic deformation (twist and bend)
+enum shape_matching_mode_enum { shape_matching_rigid, shape_matching_linear, shape_matching_quadratic };
 
 struct simulation_parameter
 {
@@ -6,18 +13,67 @@ struct simulation_parameter
     float collision_radius = 0.04f;
 
     // Ratio considered for plastic deformation on the reference shape \in [0,1]	
+    //  (creep: part of the current deformation transferred to the reference shape at each time step)
 	float plasticity = 0.0f;
+    // Deformation (norm of S-Id) below which there is no plastic deformation
+    float plasticity_yield = 0.05f;
+    // Maximal plastic deformation (norm of Sp-Id)
+    float plasticity_max = 1.0f;
     // Ratio considered for elastic deformation
+    //  (beta of the linear and quadratic modes: 0 = rigid goal positions, 1 = goal positions following the deformation)
     float elasticity = 0.0f;
+    // Deformation mode of the shape matching
+    shape_matching_mode_enum shape_matching_mode = shape_matching_rigid;
+    // Region-based shape matching: each shape is matched as a set of overlapping clusters, the goal positions being averaged over the clusters
+    bool clustered_shape_matching = false;
+    // Size of the voxels defining the clusters (each cluster covers 2x2x2 voxels of the reference shape)
+    float cluster_size = 0.1f;
     // Velocity reduction at each time step (* dt);
     float friction = 1.0f;
     // Numer of collision handling step for each numerical integration
     int collision_steps = 5;
+    // Only consider the particles of shapes whose bounding box collides with another shape in the spatial hash
+    //  (the boxes are tested by sweep and prune: O(S log S) for S shapes, much cheaper than hashing the particles of the isolated shapes)
+    bool bounding_box_early_out = true;
+
+    // Sleeping of the shapes at rest: a shape whose kinetic energy stays below sleep_energy during sleep_steps time steps is not simulated anymore
+    //  until an awake shape comes into contact with it
+    bool sleeping = true;
+    // Threshold on the kinetic energy per particle (1/2 |v|^2, unit mass)
+    float sleep_energy = 5e-3f;
+    // Number of consecutive calm time steps before sleeping
+    int sleep_steps = 60;
 
 
     // Time step of the numerical time integration
 	float time_step = 0.005f;
 };
 
-void simulation_step(std::vector<shape_deformable_structure>& deformables, simulation_parameter const& param);
+// Intermediate buffers of the simulation
+//  They are kept between the time steps to avoid reallocations, and don't carry any state from one step to the next:
+//  each simulated world uses its own workspace (the simulation of several worlds can run concurrently).
+struct simulation_workspace_structure
+{
+    // Shape matching: matrices A_pq, rotations, and quadratic transformations A~ of the shapes
+    std::vector<cgp::mat3> M;
+    std::vector<cgp::mat3> R;
+    std::vector<Eigen::Matrix<float,3,9>> A_quadratic;
+
+    // Region-based shape matching: centers of mass, matrices A_pq, and goal transformations of the clusters
+    std::vector<cgp::vec3> cluster_com;
+    std::vector<cgp::mat3> cluster_M;
+    std::vector<cgp::mat3> cluster_G;
+
+    // Collisions between particles
+    std::vector<cgp::bounding_box> bbox;  // Bounding boxes of the shapes (early-out)
+    std::vector<cgp::vec3> position;      // Gathered particles of the candidate shapes: predicted position,
+    std::vector<int> shape_index;         //  index of its deformable shape,
+    std::vector<int> particle_index;      //  and index of the particle in the world arrays
+    spatial_hash_structure spatial_hash;
+    std::vector<cgp::int2> pairs;
+    std::vector<cgp::int2> sorted_pairs;
+    std::vector<int> batch_start;
+};
+
+void simulation_step(deformable_world_structure& world, simulation_parameter const& param, simulation_workspace_structure& workspace);
 
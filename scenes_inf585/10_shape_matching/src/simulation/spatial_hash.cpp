@@ -0,0 +1,127 @@
+#include "spatial_hash.hpp"
+
+using namespace cgp;
+
+
+int3 spatial_hash_structure::cell(vec3 const& p) const
+{
+    return { int(std::floor(p.x / cell_size)), int(std::floor(p.y / cell_size)), int(std::floor(p.z / cell_size)) };
+}
+
+int spatial_hash_structure::bucket(int3 const& c) const
+{
+    // Hash function of [Teschner et al. 2003, Optimized Spatial Hashing for Collision Detection of Deformable Objects]
+    int const N_bucket = int(bucket_start.size()) - 1;
+    unsigned int const h = (unsigned int)(c.x) * 73856093u ^ (unsigned int)(c.y) * 19349663u ^ (unsigned int)(c.z) * 83492791u;
+    return int(h % (unsigned int)N_bucket);
+}
+
+void spatial_hash_structure::build(std::vector<vec3> const& position, float cell_size_arg)
+{
+    cell_size = cell_size_arg;
+    int const N = int(position.size());
+    int const N_bucket = 2 * N + 1; // About half of the buckets are empty: few hash collisions
+
+    bucket_start.assign(N_bucket + 1, 0);
+    bucket_of.resize(N);
+    particles.resize(N);
+
+    // Counting sort of the particles by bucket
+    for (int k = 0; k < N; ++k) {
+        bucket_of[k] = bucket(cell(position[k]));
+        bucket_start[bucket_of[k] + 1]++;
+    }
+    for (int b = 0; b < N_bucket; ++b)
+        bucket_start[b + 1] += bucket_start[b];
+
+    fill.assign(bucket_start.begin(), bucket_start.end() - 1);
+    for (int k = 0; k < N; ++k)
+        particles[fill[bucket_of[k]]++] = k;
+}
+
+int spatial_hash_structure::number_of_buckets() const
+{
+    return int(bucket_start.size()) - 1;
+}
+
+void spatial_hash_structure::find_pairs(std::vector<vec3> const& position, std::vector<int> const& group, float distance, std::vector<int2>& pairs)
+{
+    int const N = int(position.size());
+    float const distance2 = distance * distance;
+
+    // The particles are split in a fixed number of chunks, each one filling its own list of pairs:
+    //  the concatenation of the lists in the chunk order doesn't depend on the number of threads
+    int const N_chunk = 64;
+    chunk_pairs.resize(N_chunk);
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int chunk = 0; chunk < N_chunk; ++chunk) {
+        std::vector<int2>& local_pairs = chunk_pairs[chunk];
+        local_pairs.clear();
+
+        for (int i = chunk * N / N_chunk; i < (chunk + 1) * N / N_chunk; ++i) {
+            vec3 const& pi = position[i];
+            int3 const c = cell(pi);
+
+            // Several neighboring cells may share the same bucket: each bucket is visited once
+            int visited[27];
+            int N_visited = 0;
+
+            for (int dz = -1; dz <= 1; ++dz) {
+                for (int dy = -1; dy <= 1; ++dy) {
+                    for (int dx = -1; dx <= 1; ++dx) {
+                        int const b = bucket({ c.x + dx, c.y + dy, c.z + dz });
+                        bool already_visited = false;
+                        for (int k = 0; k < N_visited && !already_visited; ++k)
+                            already_visited = (visited[k] == b);
+                        if (already_visited)
+                            continue;
+                        visited[N_visited++] = b;
+
+                        for (int k = bucket_start[b]; k < bucket_start[b + 1]; ++k) {
+                            int const j = particles[k];
+                            if (j <= i || group[j] == group[i])
+                                continue;
+                            vec3 const d = position[j] - pi;
+                            if (dot(d, d) < distance2)
+                                local_pairs.push_back({ i, j });
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    pairs.clear();
+    for (int chunk = 0; chunk < N_chunk; ++chunk)
+        pairs.insert(pairs.end(), chunk_pairs[chunk].begin(), chunk_pairs[chunk].end());
+}
+
+void spatial_hash_structure::sort_pairs_by_color(std::vector<vec3> const& position, std::vector<int2> const& pairs, std::vector<int2>& sorted_pairs, std::vector<int>& batch_start)
+{
+    int const N_pair = int(pairs.size());
+    int const N_bucket = number_of_buckets();
+    int const N_batch = 8 * N_bucket;
+
+    // Batch of each pair: color of the block of the first particle, and bucket of this block
+    batch_of.resize(N_pair);
+    #pragma omp parallel for schedule(static)
+    for (int k = 0; k < N_pair; ++k) {
+        int3 const c = cell(position[pairs[k].x]);
+        int3 const block = { (c.x - (c.x < 0)) / 2, (c.y - (c.y < 0)) / 2, (c.z - (c.z < 0)) / 2 }; // floor(c/2), also for negative coordinates
+        int const color = (block.x & 1) + 2 * (block.y & 1) + 4 * (block.z & 1);
+        batch_of[k] = color * N_bucket + bucket(block);
+    }
+
+    // Stable counting sort of the pairs by batch
+    batch_start.assign(N_batch + 1, 0);
+    for (int k = 0; k < N_pair; ++k)
+        batch_start[batch_of[k] + 1]++;
+    for (int b = 0; b < N_batch; ++b)
+        batch_start[b + 1] += batch_start[b];
+
+    fill.assign(batch_start.begin(), batch_start.end() - 1);
+    sorted_pairs.resize(N_pair);
+    for (int k = 0; k < N_pair; ++k)
+        sorted_pairs[fill[batch_of[k]]++] = pairs[k];
+}
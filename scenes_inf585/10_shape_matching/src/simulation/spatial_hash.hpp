@@ -0,0 +1,45 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+
+
+// Spatial hash of a set of particles on an (infinite) uniform grid
+//  - Each particle is stored in the bucket associated to its grid cell. Several cells may share the same bucket (hash collisions):
+//    the buckets only give candidates, that are then filtered by their distance.
+//  - The buckets are stored as a single sorted array (counting sort): no allocation once the arrays reached their size.
+//  - With a cell size greater than or equal to the search distance, the neighbors of a particle are in its 27 surrounding cells:
+//    the pairs are found in a time linear in the number of particles (for a bounded density).
+struct spatial_hash_structure {
+
+    float cell_size = 1.0f;
+
+    std::vector<int> bucket_start; // Particles of the bucket b are particles[bucket_start[b] .. bucket_start[b+1]-1]
+    std::vector<int> particles;    // Indices of the particles sorted by bucket
+    std::vector<int> bucket_of;    // Bucket of each particle
+
+    // Fill the hash with the given positions
+    void build(std::vector<cgp::vec3> const& position, float cell_size);
+
+    // Fill pairs with all the pairs (i,j), i<j, of particles closer than distance (distance <= cell_size) and belonging to different groups
+    //  group[i] is the index of the group (e.g. the deformable shape) of the particle i
+    //  The search is parallel, the pairs are always given in the same order (sorted by i, then by bucket) whatever the number of threads.
+    void find_pairs(std::vector<cgp::vec3> const& position, std::vector<int> const& group, float distance, std::vector<cgp::int2>& pairs);
+
+    // Sort the pairs into independent batches, in order to process them in parallel without conflicts
+    //  Each pair (i,j) is associated to the block of 2x2x2 cells containing the particle i, and the blocks are split in 8 colors (parity of their coordinates).
+    //  Two blocks of the same color are at least 2 cells apart: their pairs never share a particle and can be processed in parallel.
+    //  The pairs of the color c and of the block-bucket b are sorted_pairs[batch_start[c*N_bucket+b] .. batch_start[c*N_bucket+b+1]-1]
+    //   (in the order of pairs), with N_bucket = number_of_buckets().
+    void sort_pairs_by_color(std::vector<cgp::vec3> const& position, std::vector<cgp::int2> const& pairs, std::vector<cgp::int2>& sorted_pairs, std::vector<int>& batch_start);
+
+    int number_of_buckets() const;
+
+    cgp::int3 cell(cgp::vec3 const& p) const;
+    int bucket(cgp::int3 const& c) const;
+
+private:
+    // Buffers kept between the calls to avoid reallocations
+    std::vector<int> fill;                           // Insertion position of each bucket/batch during the counting sorts
+    std::vector<std::vector<cgp::int2>> chunk_pairs; // Pairs found by each chunk of particles (find_pairs)
+    std::vector<int> batch_of;                       // Batch of each pair (sort_pairs_by_color)
+};
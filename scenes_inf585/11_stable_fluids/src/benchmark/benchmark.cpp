@@ -0,0 +1,183 @@
+#include "benchmark.hpp"
+
+#include "simulation/simulation.hpp"
+#include "simulation/simulation_3D.hpp"
+#include "helper/helper.hpp"
+
+#include <iostream>
+#include <iomanip>
+
+using namespace cgp;
+
+
+// Settings of one run of the 2D benchmark
+struct benchmark_2D_configuration {
+    int N;                    // Grid of N x N cells
+    bool mac_grid;            // Staggered or collocated velocity
+    int diffusion_iterations; // Gauss-Seidel sweeps of the diffusion
+    float pressure_tolerance; // Tolerance of the multigrid solver
+};
+
+// Measures of one run (averaged over the timed steps)
+struct benchmark_2D_result {
+    float diffuse = 0.0f;     // ms per step for each stage (velocity and density)
+    float project = 0.0f;
+    float advect = 0.0f;
+    float total = 0.0f;
+    float divergence = 0.0f;  // RMS divergence of the velocity after the projection
+    float cycles = 0.0f;      // V-cycles per projection
+};
+
+// Scripted interaction replacing the mouse: an impulse moving on a circle around the center of the domain
+//  The impulse is applied as in scene_structure::mouse_move_event, using mouse_velocity_to_grid with world coordinates (identity projection)
+static void scripted_impulse(fluid_2D_structure& fluid, int k_step)
+{
+    float const angle = 0.15f * k_step;
+    vec2 const p = 0.5f * vec2(std::cos(angle), std::sin(angle));
+    vec2 const v = 0.6f * vec2(-std::sin(angle), std::cos(angle));
+    if (fluid.parameters.mac_grid) {
+        fluid.velocity_average.fill({ 0,0 });
+        mouse_velocity_to_grid(fluid.velocity_average, v, mat4::build_identity(), p);
+        add_cell_velocity_to_faces(fluid.mac_velocity, fluid.velocity_average);
+    }
+    else
+        mouse_velocity_to_grid(fluid.velocity.front(), v, mat4::build_identity(), p);
+}
+
+static benchmark_2D_result run_benchmark_2D(benchmark_2D_configuration const& config, int N_warmup, int N_step)
+{
+    // The step is fluid_2D_structure::simulate, the one run by the scene
+    float const dt = 0.2f;
+    int const N = config.N;
+
+    fluid_2D_structure fluid;
+    fluid.initialize(N, N, grid_cell_size(N, N));
+    initialize_density_color(fluid.density.front(), N, N);
+    fluid.density.resize_back_to_front();
+    fluid.pressure_solver.parameters.tolerance = config.pressure_tolerance;
+    fluid.parameters.mac_grid = config.mac_grid;
+    fluid.parameters.diffusion_iterations = config.diffusion_iterations;
+    fluid.parameters.measure_divergence = true;
+
+    benchmark_2D_result result;
+    for (int k_step = 0; k_step < N_warmup + N_step; ++k_step) {
+        // The impulse and the measure of the divergence are not part of the timing
+        scripted_impulse(fluid, k_step);
+        fluid.simulate(dt);
+        if (k_step >= N_warmup) {
+            result.diffuse += fluid.timing.diffuse;
+            result.project += fluid.timing.project;
+            result.advect += fluid.timing.advect;
+            result.total += fluid.timing.total;
+            result.divergence += fluid.divergence_rms;
+            result.cycles += float(fluid.pressure_solver.statistics.cycles);
+        }
+    }
+
+    result.diffuse /= N_step;
+    result.project /= N_step;
+    result.advect /= N_step;
+    result.total /= N_step;
+    result.divergence /= N_step;
+    result.cycles /= N_step;
+    return result;
+}
+
+void benchmark_fluid_2D()
+{
+    int const resolutions[] = { 64, 128, 256, 512, 1024 };
+    int const diffusion_iterations[] = { 5, 15 };
+    float const pressure_tolerances[] = { 1e-2f, 1e-3f, 1e-4f };
+    int const N_warmup = 5;
+    int const N_step = 20;
+
+    std::cout << "\nBenchmark 2D stable fluids (" << N_step << " steps per configuration, times in ms/step)" << std::endl;
+    std::cout << std::setw(6) << "N" << std::setw(12) << "layout" << std::setw(8) << "diff" << std::setw(10) << "tol"
+        << std::setw(10) << "diffuse" << std::setw(10) << "project" << std::setw(10) << "advect" << std::setw(10) << "total"
+        << std::setw(8) << "cycles" << std::setw(12) << "divergence" << std::setw(12) << "Mcells/s" << std::endl;
+
+    for (int N : resolutions) {
+        for (int k_layout = 0; k_layout < 2; ++k_layout) {
+            for (int iterations : diffusion_iterations) {
+                for (float tolerance : pressure_tolerances) {
+                    benchmark_2D_configuration const config = { N, k_layout == 1, iterations, tolerance };
+                    benchmark_2D_result const result = run_benchmark_2D(config, N_warmup, N_step);
+
+                    double const cells = double(N) * N;
+                    std::cout << std::setw(6) << N
+                        << std::setw(12) << (config.mac_grid ? "MAC" : "collocated")
+                        << std::setw(8) << iterations
+                        << std::setw(10) << std::scientific << std::setprecision(0) << tolerance
+                        << std::fixed << std::setprecision(2)
+                        << std::setw(10) << result.diffuse
+                        << std::setw(10) << result.project
+                        << std::setw(10) << result.advect
+                        << std::setw(10) << result.total
+                        << std::setw(8) << std::setprecision(1) << result.cycles
+                        << std::setw(12) << std::scientific << std::setprecision(2) << result.divergence
+                        << std::setw(12) << std::fixed << cells / (result.total * 1e3)
+                        << std::endl;
+                }
+            }
+        }
+    }
+}
+
+
+void benchmark_fluid_3D()
+{
+    int const resolutions[] = { 64, 128, 256 };
+    float const pressure_tolerances[] = { 1e-2f, 1e-3f, 1e-4f };
+    int const N_warmup = 2;  // Steps not included in the timing
+    int const N_step = 10;
+    float const dt = 0.2f;
+
+    std::cout << "\nBenchmark 3D stable fluids (" << N_step << " steps per configuration, times in ms/step)" << std::endl;
+    std::cout << std::setw(8) << "N" << std::setw(10) << "tol" << std::setw(12) << "ms/step" << std::setw(12) << "diffuse" << std::setw(12) << "project" << std::setw(12) << "advect"
+        << std::setw(8) << "cycles" << std::setw(12) << "residual" << std::setw(12) << "divergence" << std::setw(16) << "Mcells/s" << std::endl;
+
+    for (int N : resolutions) {
+        for (float tolerance : pressure_tolerances) {
+            fluid_3D_structure fluid;
+            fluid.initialize(N, N, N);
+            fluid.pressure_solver.parameters.tolerance = tolerance;
+            fluid.parameters.measure_divergence = true;
+
+            fluid_timing sum;
+            float cycles = 0.0f;
+            float residual = 0.0f;   // RMS residual of the Poisson equation relative to the RMS of its right-hand side
+            float divergence = 0.0f; // RMS divergence after the projection
+            for (int k_step = 0; k_step < N_warmup + N_step; ++k_step) {
+                // Rising plume injected at the bottom of the domain
+                fluid.add_source({ N / 2.0f, N / 2.0f, N / 8.0f }, N / 10.0f, 1.0f, { 0, 0, N / 20.0f });
+                fluid.simulate(dt);
+                if (k_step >= N_warmup) {
+                    multigrid_statistics const& stats = fluid.pressure_solver.statistics;
+                    sum.diffuse += fluid.timing.diffuse;
+                    sum.project += fluid.timing.project;
+                    sum.advect += fluid.timing.advect;
+                    sum.total += fluid.timing.total;
+                    cycles += float(stats.cycles);
+                    residual += stats.rhs_norm > 0 ? stats.residual_final / stats.rhs_norm : 0.0f;
+                    divergence += fluid.divergence_rms;
+                }
+            }
+
+            float const ms_step = sum.total / N_step;
+            double const cells = double(N) * N * N;
+            std::cout << std::setw(8) << N
+                << std::setw(10) << std::scientific << std::setprecision(0) << tolerance
+                << std::fixed << std::setprecision(2)
+                << std::setw(12) << ms_step
+                << std::setw(12) << sum.diffuse / N_step
+                << std::setw(12) << sum.project / N_step
+                << std::setw(12) << sum.advect / N_step
+                << std::setw(8) << std::setprecision(1) << cycles / N_step
+                << std::scientific << std::setprecision(2)
+                << std::setw(12) << residual / N_step
+                << std::setw(12) << divergence / N_step
+                << std::setw(16) << std::fixed << cells / (ms_step * 1e3)
+                << std::endl;
+        }
+    }
+}
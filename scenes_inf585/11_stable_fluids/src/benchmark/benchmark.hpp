@@ -0,0 +1,13 @@
+#pragma once
+
+// Headless benchmarks of the fluid solvers (no window nor OpenGL context is needed)
+//  Called from main() using the command line arguments, e.g. "./11_stable_fluids --benchmark-2D" or "./11_stable_fluids --benchmark-3D"
+
+// Runs the 2D solver on fixed scenarios (density of initialize_density_color, scripted impulses instead of the mouse)
+//  for a sweep of grid sizes, velocity layouts and solver settings.
+//  Reports the time of each stage, the divergence after the projection, the number of V-cycles, and the throughput in cells/s.
+void benchmark_fluid_2D();
+
+// Runs the 3D solver on a rising smoke plume at 64^3, 128^3 and 256^3 for a sweep of pressure tolerances.
+//  Reports the time per step, the number of V-cycles, the relative residual of the Poisson equation and the divergence after the projection.
+void benchmark_fluid_3D();
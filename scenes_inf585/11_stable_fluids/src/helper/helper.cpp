@@ -2,59 +2,114 @@
 
 using namespace cgp;
 
-void initialize_density_color(grid_2D<vec3>& density, size_t N)
+// The grid is displayed with square cells, its largest dimension covering [-1,1]
+float grid_cell_size(int Nx, int Ny)
 {
-    density.resize(N,N);
+	return 2.0f/(std::max(Nx,Ny)-1.0f);
+}
+
+vec2 grid_to_world(float kx, float ky, int Nx, int Ny)
+{
+	float const L = grid_cell_size(Nx, Ny);
+	return { (kx-(Nx-1)/2.0f)*L, (ky-(Ny-1)/2.0f)*L };
+}
+
+void initialize_density_color(grid_2D<vec3>& density, int Nx, int Ny)
+{
+    density.resize(Nx,Ny);
     density.fill({1,1,1});
-    for(size_t kx=N/6; kx<N/2; ++kx)
-        for(size_t ky=N/6; ky<5*N/6; ++ky)
+    for(int ky=Ny/6; ky<5*Ny/6; ++ky) {
+        for(int kx=Nx/6; kx<Nx/2; ++kx)
             density(kx,ky) = {1,0,0};
-    for(size_t kx=N/2; kx<5*N/6; ++kx)
-        for(size_t ky=N/6; ky<5*N/6; ++ky)
+        for(int kx=Nx/2; kx<5*Nx/6; ++kx)
             density(kx,ky) = {0,1,0};
+    }
+}
 
+void initialize_density_image(grid_2D<vec3>& density, image_structure const& image, int Nx, int Ny)
+{
+	grid_2D<vec3> density_image;
+	convert(image, density_image);
+	int const Nx_image = int(density_image.dimension.x);
+	int const Ny_image = int(density_image.dimension.y);
+
+	// Bilinear resampling of the image to the resolution of the simulation
+	density.resize(Nx,Ny);
+	#pragma omp parallel for schedule(static)
+	for(int ky=0; ky<Ny; ++ky) {
+		for(int kx=0; kx<Nx; ++kx) {
+			float const x = kx*(Nx_image-1.0f)/std::max(Nx-1,1);
+			float const y = ky*(Ny_image-1.0f)/std::max(Ny-1,1);
+			density(kx,ky) = interpolation_bilinear(density_image, x, y);
+		}
+	}
 }
 
-void initialize_density_visual(mesh_drawable& density_visual, size_t N)
+void initialize_density_visual(mesh_drawable& density_visual, int Nx, int Ny)
 {
-	float const dx = 2.0f/(N-1.0f);
-	density_visual.initialize_data_on_gpu(mesh_primitive_quadrangle({-1-dx/2,-1-dx/2,0},{1+dx/2,-1-dx/2,0},{1+dx/2,1+dx/2,0}, {-1-dx/2, 1+dx/2, 0}) );
-	
+	float const dx = grid_cell_size(Nx, Ny);
+	vec2 const p0 = grid_to_world(0, 0, Nx, Ny) - vec2(dx/2, dx/2);
+	vec2 const p1 = grid_to_world(Nx-1, Ny-1, Nx, Ny) + vec2(dx/2, dx/2);
+	density_visual.initialize_data_on_gpu(mesh_primitive_quadrangle({p0.x,p0.y,0},{p1.x,p0.y,0},{p1.x,p1.y,0}, {p0.x, p1.y, 0}) );
+
 	density_visual.material.phong = {1,0,0,1};
 	density_visual.material.color = {1,1,1};
 	density_visual.material.texture_settings.inverse_v = false;
 }
 
-void initialize_grid(curve_drawable& grid_visual, size_t N)
+void initialize_grid(curve_drawable& grid_visual, int Nx, int Ny)
 {
 
     numarray<vec3> edges;
 	float const e = 1e-4f;
-    float const dx = 2.0f/(N-1.0f);
-    for(int kx=0; kx<=N; ++kx) {
-        float const x  = kx*dx-1;
-        edges.push_back( vec3(x-dx/2, -dx/2-1, e) );
-        edges.push_back( vec3(x-dx/2, 1+dx/2, e) );
+    float const dx = grid_cell_size(Nx, Ny);
+	vec2 const p0 = grid_to_world(0, 0, Nx, Ny) - vec2(dx/2, dx/2);
+	vec2 const p1 = grid_to_world(Nx-1, Ny-1, Nx, Ny) + vec2(dx/2, dx/2);
+    for(int kx=0; kx<=Nx; ++kx) {
+        float const x  = p0.x + kx*dx;
+        edges.push_back( vec3(x, p0.y, e) );
+        edges.push_back( vec3(x, p1.y, e) );
     }
-    for(int ky=0; ky<=N; ++ky) {
-        float const y  = ky*dx-1;
-        edges.push_back( vec3(-dx/2-1, y-dx/2, e) );
-        edges.push_back( vec3(1+dx/2, y-dx/2, e) );
+    for(int ky=0; ky<=Ny; ++ky) {
+        float const y  = p0.y + ky*dx;
+        edges.push_back( vec3(p0.x, y, e) );
+        edges.push_back( vec3(p1.x, y, e) );
     }
 
     grid_visual.initialize_data_on_gpu(edges);
 }
 
-void update_velocity_visual(curve_drawable& velocity_visual, numarray<vec3>& velocity_grid_data, grid_2D<vec2> const& velocity, float scale)
+int2 velocity_visual_dimension(int Nx, int Ny, int max_arrows)
+{
+	return { std::min(Nx, max_arrows), std::min(Ny, max_arrows) };
+}
+
+void initialize_velocity_visual(curve_drawable& velocity_visual, numarray<vec3>& velocity_grid_data, int Nx, int Ny, int max_arrows)
 {
-	int const N = int(velocity.dimension.x);
-	float const dL = 2.0f/(N-1.0f);
-	float const lambda = 0.01f * scale;
-
-	for(int kx=0; kx<N; ++kx){
-		for(int ky=0; ky<N; ++ky){
-			vec3 const p0 = {-1+kx*dL, -1+ky*dL, 1e-4f};
-			size_t const offset = velocity.index_to_offset(kx,ky);
+	int2 const dim = velocity_visual_dimension(Nx, Ny, max_arrows);
+	velocity_grid_data.resize(2*dim.x*dim.y);
+	velocity_grid_data.fill(vec3(0,0,0));
+	velocity_visual.initialize_data_on_gpu(velocity_grid_data);
+}
+
+void update_velocity_visual(curve_drawable& velocity_visual, numarray<vec3>& velocity_grid_data, grid_2D<vec2> const& velocity, float scale, int max_arrows)
+{
+	int const Nx = int(velocity.dimension.x);
+	int const Ny = int(velocity.dimension.y);
+	float const lambda = 0.3f * scale; // The velocity is in world units
+
+	// Display at most max_arrows x max_arrows arrows: the velocity is sampled every step_x/step_y cells
+	int2 const dim = velocity_visual_dimension(Nx, Ny, max_arrows);
+	float const step_x = Nx/float(dim.x);
+	float const step_y = Ny/float(dim.y);
+
+	#pragma omp parallel for schedule(static)
+	for(int iy=0; iy<dim.y; ++iy){
+		int const ky = std::min(int((iy+0.5f)*step_y), Ny-1);
+		for(int ix=0; ix<dim.x; ++ix){
+			int const kx = std::min(int((ix+0.5f)*step_x), Nx-1);
+			vec3 const p0 = vec3(grid_to_world(kx, ky, Nx, Ny), 1e-4f);
+			int const offset = ix + dim.x*iy;
 			velocity_grid_data[2*offset+0] = p0;
 			velocity_grid_data[2*offset+1] = p0 + lambda*vec3(velocity(kx,ky),0.0f);
 		}
@@ -65,12 +120,14 @@ void update_velocity_visual(curve_drawable& velocity_visual, numarray<vec3>& vel
 
 void density_to_velocity_curl(grid_2D<vec3>& density, grid_2D<vec2> const& velocity)
 {
-	size_t const N = velocity.dimension.x;
-	float const dL = 2.0f/(N-1);
-	for (size_t kx = 0; kx < N-1; ++kx){
-		for (size_t ky = 0; ky < N-1; ++ky){
-
-			float const w = 0.01f*((velocity(kx+1,ky).y-velocity(kx,ky).y)/dL - (velocity(kx,ky+1).x-velocity(kx,ky).x)/dL);
+	int const Nx = int(velocity.dimension.x);
+	int const Ny = int(velocity.dimension.y);
+	float const dL = grid_cell_size(Nx, Ny);
+	#pragma omp parallel for schedule(static)
+	for (int ky = 0; ky < Ny-1; ++ky){
+		for (int kx = 0; kx < Nx-1; ++kx){
+
+			float const w = 0.3f*((velocity(kx+1,ky).y-velocity(kx,ky).y)/dL - (velocity(kx,ky+1).x-velocity(kx,ky).x)/dL);
 			float const wp = clamp(w,0,1);
 			float const wn = clamp(-w,0,1);
 
@@ -85,28 +142,34 @@ void density_to_velocity_curl(grid_2D<vec3>& density, grid_2D<vec2> const& veloc
 
 void mouse_velocity_to_grid(grid_2D<vec2>& velocity, vec2 const& mouse_velocity, mat4 const& P_inv, vec2 const& p_mouse)
 {
-    size_t const N = velocity.dimension.x;
-	float const L = 2.0f/(N-1.0f);
+	int const Nx = int(velocity.dimension.x);
+	int const Ny = int(velocity.dimension.y);
+	float const L = grid_cell_size(Nx, Ny);
 
 	vec2 const picked = (P_inv*vec4(p_mouse,0,1)).xy();
-	vec2 const p0 = vec2(-1-L/2,-1-L/2); // grid extremity
-	vec2 const p1 = vec2( 1+L/2, 1+L/2);
-	int const x = std::floor( N*(picked.x-p0.x)/(p1.x-p0.x) );
-	int const y = std::floor( N*(picked.y-p0.y)/(p1.y-p0.y) );
-	for (int dx = -5; dx < 5; ++dx)
+	vec2 const p0 = grid_to_world(0, 0, Nx, Ny);
+	int const x = int(std::round( (picked.x-p0.x)/L ));
+	int const y = int(std::round( (picked.y-p0.y)/L ));
+
+	// The influence radius and the velocity of the impulse are defined in world units: the same stroke has the same effect at all resolutions
+	//  (the impulse has the magnitude of the original 5 cells per unit of time on the 60x60 grid)
+	float const sigma = 0.05f;
+	float const impulse = 0.17f;
+	int const R = std::max(int(std::ceil(2*sigma/L)), 1);
+	for (int dy = -R; dy < R; ++dy)
 	{
-		for (int dy = -5; dy < 5; ++dy)
+		for (int dx = -R; dx < R; ++dx)
 		{
 			int const xc = x+dx;
 			int const yc = y+dy;
 
-			if(xc>1 && yc>1 && xc<int(N-2) && yc<int(N-2)) {
+			if(xc>1 && yc>1 && xc<Nx-2 && yc<Ny-2) {
 				// Set mouse speed to the corresponding entry of the velocity
-				float const dist = norm(picked-vec2{-1-L/2+xc*L, -1-L/2+yc*L});
-				float const weight = exp(-(dist*dist)/(0.05f*0.05f));
+				float const dist = norm(picked-grid_to_world(xc, yc, Nx, Ny));
+				float const weight = exp(-(dist*dist)/(sigma*sigma));
 
-				velocity(xc,yc) += 5.0f * weight * mouse_velocity;
+				velocity(xc,yc) += impulse * weight * mouse_velocity;
 			}
 		}
 	}
-}
\ No newline at end of file
+}
@@ -3,11 +3,19 @@
 #include "cgp/cgp.hpp"
 
 
-void initialize_density_color(cgp::grid_2D<cgp::vec3>& density, size_t N);
-void initialize_density_visual(cgp::mesh_drawable& density_visual, size_t N);
-void initialize_grid(cgp::curve_drawable& grid_visual, size_t N);
+// Size of a cell and world position of the cell (kx,ky) for a grid of Nx x Ny cells displayed with its largest dimension covering [-1,1]
+float grid_cell_size(int Nx, int Ny);
+cgp::vec2 grid_to_world(float kx, float ky, int Nx, int Ny);
 
-void update_velocity_visual(cgp::curve_drawable& velocity_visual, cgp::numarray<cgp::vec3>& velocity_grid_data, cgp::grid_2D<cgp::vec2> const& velocity, float scale);
+void initialize_density_color(cgp::grid_2D<cgp::vec3>& density, int Nx, int Ny);
+void initialize_density_image(cgp::grid_2D<cgp::vec3>& density, cgp::image_structure const& image, int Nx, int Ny);
+void initialize_density_visual(cgp::mesh_drawable& density_visual, int Nx, int Ny);
+void initialize_grid(cgp::curve_drawable& grid_visual, int Nx, int Ny);
+
+// The velocity is displayed using at most max_arrows x max_arrows arrows, independently of the resolution of the simulation
+cgp::int2 velocity_visual_dimension(int Nx, int Ny, int max_arrows);
+void initialize_velocity_visual(cgp::curve_drawable& velocity_visual, cgp::numarray<cgp::vec3>& velocity_grid_data, int Nx, int Ny, int max_arrows);
+void update_velocity_visual(cgp::curve_drawable& velocity_visual, cgp::numarray<cgp::vec3>& velocity_grid_data, cgp::grid_2D<cgp::vec2> const& velocity, float scale, int max_arrows);
 
 void mouse_velocity_to_grid(cgp::grid_2D<cgp::vec2>& velocity, cgp::vec2 const& mouse_velocity, cgp::mat4 const& P_inv, cgp::vec2 const& p_mouse);
-void density_to_velocity_curl(cgp::grid_2D<cgp::vec3>& density, cgp::grid_2D<cgp::vec2> const& velocity);
\ No newline at end of file
+void density_to_velocity_curl(cgp::grid_2D<cgp::vec3>& density, cgp::grid_2D<cgp::vec2> const& velocity);
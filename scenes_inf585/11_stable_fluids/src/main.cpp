@@ -9,6 +9,7 @@
 
 // Custom scene of this code
 #include "scene.hpp"
+#include "benchmark/benchmark.hpp"
 
 
 
@@ -32,10 +33,19 @@ void display_gui_default();
 
 timer_fps fps_record;
 
-int main(int, char* argv[])
+int main(int argc, char* argv[])
 {
 	std::cout << "Run " << argv[0] << std::endl;
 
+	// Headless benchmarks: run without opening a window
+	if (argc > 1 && std::string(argv[1]) == "--benchmark-2D") {
+		benchmark_fluid_2D();
+		return 0;
+	}
+	if (argc > 1 && std::string(argv[1]) == "--benchmark-3D") {
+		benchmark_fluid_3D();
+		return 0;
+	}
 	
 
 	// ************************ //
@@ -19,64 +19,57 @@ void scene_structure::initialize()
 	// Initialize the shapes of the scene
 	// ***************************************** //
 	initialize_fields(gui.density_type);
-	int const N = velocity.dimension.x;
-	initialize_density_visual(density_visual, N);
-	density_visual.texture.initialize_texture_2d_on_gpu(density);
-	initialize_grid(grid_visual, N);
+	initialize_visuals();
+}
+
+void scene_structure::initialize_visuals()
+{
+	int const Nx = fluid.velocity.front().dimension.x;
+	int const Ny = fluid.velocity.front().dimension.y;
+
+	// Clear the previous visuals before setting the new ones: the function is called again for each new resolution
+	density_visual.clear();
+	grid_visual.clear();
+	velocity_visual.clear();
+
+	initialize_density_visual(density_visual, Nx, Ny);
+	density_visual.texture.initialize_texture_2d_on_gpu(fluid.density.front());
+	initialize_grid(grid_visual, Nx, Ny);
 	grid_visual.color = { 0,0,0.5 };
 
-	velocity_grid_data.resize(2 * N * N);
-	velocity_visual.initialize_data_on_gpu(velocity_grid_data);
+	// The number of displayed arrows is bounded independently of the resolution of the simulation
+	initialize_velocity_visual(velocity_visual, velocity_grid_data, Nx, Ny, gui.velocity_arrows);
 	velocity_visual.color = vec3(0, 0, 0);
 
 	grid_visual.display_type = curve_drawable_display_type::Segments;
 	velocity_visual.display_type = curve_drawable_display_type::Segments;
 }
 
-void scene_structure::simulate(float dt)
-{
-	velocity_previous = velocity;
-	density_previous = density;
-
-	// velocity
-	diffuse(velocity, velocity_previous, gui.diffusion_velocity, dt, reflective); velocity_previous = velocity;
-	divergence_free(velocity, velocity_previous, divergence, gradient_field); velocity_previous = velocity;
-	advect(velocity, velocity_previous, velocity_previous, dt);
-
-	// density
-	if (gui.density_type != view_velocity_curl) {
-		diffuse(density, density_previous, gui.diffusion_density, dt, copy); density_previous = density;
-		advect(density, density_previous, velocity, dt);
-	}
-	else // in case you directly look at the velocity curl (no density advection in this case)
-		density_to_velocity_curl(density, velocity);
-}
-
-void scene_structure::initialize_density(density_type_structure density_type, size_t N)
+void scene_structure::initialize_density(density_type_structure density_type, int Nx, int Ny)
 {
+	field_buffer<vec3>& density = fluid.density;
 	if (density_type == density_color) {
-		initialize_density_color(density, N);
+		initialize_density_color(density.front(), Nx, Ny);
 	}
 
 	if (density_type == density_texture) {
-		convert(image_load_png(project::path+"assets/texture.png"), density);
+		initialize_density_image(density.front(), image_load_png(project::path+"assets/texture.png"), Nx, Ny);
 	}
 
 	if (density_type == view_velocity_curl) {
-		density.resize(N, N); density.fill({ 1,1,1 });
+		density.front().resize(Nx, Ny); density.front().fill({ 1,1,1 });
 	}
 
-	density_previous = density;
+	density.resize_back_to_front();
+	fluid.tiles.initialize(Nx, Ny);
 }
 
 void scene_structure::initialize_fields(density_type_structure density_type)
 {
-	size_t const N = 60;
-	velocity.resize(N, N); velocity.fill({ 0,0 }); velocity_previous = velocity;
-	initialize_density(density_type, N);
-	divergence.clear(); divergence.resize(N, N);
-	gradient_field.clear(); gradient_field.resize(N, N);
-
+	int const Nx = gui.grid_resolution_x;
+	int const Ny = gui.grid_resolution_y;
+	fluid.initialize(Nx, Ny, grid_cell_size(Nx, Ny));
+	initialize_density(density_type, Nx, Ny);
 }
 
 void scene_structure::display_frame()
@@ -86,9 +79,16 @@ void scene_structure::display_frame()
 	
 	timer.update();
 	float const dt = 0.2f * timer.scale;
-	simulate(dt);
-	density_visual.texture.update(density);
-	update_velocity_visual(velocity_visual, velocity_grid_data, velocity, gui.velocity_scaling);
+
+	// In case you directly look at the velocity curl, there is no density advection
+	fluid.parameters.advect_density = gui.density_type != view_velocity_curl;
+	fluid.simulate(dt);
+	if (gui.density_type == view_velocity_curl)
+		density_to_velocity_curl(fluid.density.front(), fluid.velocity.front());
+
+	density_visual.texture.update(fluid.density.front());
+	if (gui.display_velocity)
+		update_velocity_visual(velocity_visual, velocity_grid_data, fluid.velocity.front(), gui.velocity_scaling, gui.velocity_arrows);
 
 	draw(density_visual, environment);
 
@@ -103,12 +103,44 @@ void scene_structure::display_frame()
 void scene_structure::display_gui()
 {
 	ImGui::SliderFloat("Timer scale", &timer.scale, 0.01f, 4.0f, "%0.2f");
-	ImGui::SliderFloat("Diffusion Density", &gui.diffusion_density, 0.001f, 0.2f, "%0.3f", 2.0f);
-	ImGui::SliderFloat("Diffusion Velocity", &gui.diffusion_velocity, 0.001f, 0.2f, "%0.3f", 2.0f);
+	ImGui::SliderFloat("Diffusion Density", &fluid.parameters.diffusion_density, 0.001f, 0.2f, "%0.3f", 2.0f);
+	ImGui::SliderFloat("Diffusion Velocity", &fluid.parameters.diffusion_velocity, 0.001f, 0.2f, "%0.3f", 2.0f);
 	ImGui::Checkbox("Grid", &gui.display_grid); ImGui::SameLine();
 	ImGui::Checkbox("Velocity", &gui.display_velocity);
 	ImGui::SliderFloat("Velocity scale", &gui.velocity_scaling, 0.1f, 10.0f, "0.2f");
 
+	grid_2D<vec2>& velocity = fluid.velocity.front();
+	sparse_tiles_structure& tiles = fluid.tiles;
+	ImGui::SliderFloat("Pressure tolerance", &fluid.pressure_solver.parameters.tolerance, 1e-5f, 1e-1f, "%.5f", 4.0f);
+	ImGui::SliderInt("Pressure max cycles", &fluid.pressure_solver.parameters.max_cycles, 1, 50);
+	multigrid_statistics const& stats = fluid.pressure_solver.statistics;
+	ImGui::Text("Multigrid: %d levels, %d V-cycles, residual %.2e -> %.2e (x%.3f/cycle)", stats.levels, stats.cycles, stats.residual_initial, stats.residual_final, stats.convergence_factor);
+	ImGui::Text("Step: %.2f ms (diffuse %.2f, project %.2f, advect %.2f)", fluid.timing.total, fluid.timing.diffuse, fluid.timing.project, fluid.timing.advect);
+
+	// The velocity is transferred between the two layouts when the option is changed
+	if (ImGui::Checkbox("MAC grid", &fluid.parameters.mac_grid)) {
+		if (fluid.parameters.mac_grid)
+			set_faces_from_cell_velocity(fluid.mac_velocity, velocity);
+		else
+			velocity_at_cell_centers(velocity, fluid.mac_velocity);
+		tiles.initialize(velocity.dimension.x, velocity.dimension.y);
+	}
+	ImGui::Checkbox("Measure divergence", &fluid.parameters.measure_divergence);
+	if (fluid.parameters.measure_divergence)
+		ImGui::Text("Divergence after projection: %.2e", fluid.divergence_rms);
+
+	if (ImGui::Checkbox("Sparse tiles", &fluid.parameters.sparse_tiles))
+		tiles.initialize(velocity.dimension.x, velocity.dimension.y);
+	if (fluid.parameters.sparse_tiles) {
+		ImGui::SliderFloat("Rest threshold", &tiles.threshold, 1e-7f, 1e-3f, "%.7f", 4.0f);
+		ImGui::SliderFloat("Density threshold", &tiles.density_threshold, 1e-5f, 1e-1f, "%.5f", 4.0f);
+		ImGui::Text("Active tiles: %d / %d (%.1f%%)", int(tiles.active_tiles.size()), tiles.Tx * tiles.Ty, 100.0f * tiles.active_ratio());
+	}
+
+	ImGui::SliderInt("Resolution x", &gui.grid_resolution_x, 16, 2048);
+	ImGui::SliderInt("Resolution y", &gui.grid_resolution_y, 16, 2048);
+	bool const new_resolution = ImGui::Button("Apply resolution");
+
 	bool const cancel_velocity = ImGui::Button("Cancel Velocity"); ImGui::SameLine();
 	bool const restart = ImGui::Button("Restart");
 
@@ -118,9 +150,16 @@ void scene_structure::display_gui()
 	new_density |= ImGui::RadioButton("Density texture", ptr_density_type, density_texture); ImGui::SameLine();
 	new_density |= ImGui::RadioButton("Velocity Curl", ptr_density_type, view_velocity_curl);
 	if (new_density || restart)
-		initialize_density(gui.density_type, velocity.dimension.x);
-	if (cancel_velocity || restart)
+		initialize_density(gui.density_type, velocity.dimension.x, velocity.dimension.y);
+	if (cancel_velocity || restart) {
 		velocity.fill({ 0,0 });
+		fluid.mac_velocity.resize(velocity.dimension.x, velocity.dimension.y);
+		tiles.initialize(velocity.dimension.x, velocity.dimension.y);
+	}
+	if (new_resolution) {
+		initialize_fields(gui.density_type);
+		initialize_visuals();
+	}
 }
 
 void scene_structure::mouse_move_event()
@@ -128,7 +167,15 @@ void scene_structure::mouse_move_event()
 	vec2 const& p = inputs.mouse.position.current;
 	if (inputs.mouse.click.left) {
 		velocity_track.add(vec3(p, 0.0f), timer.t);
-		mouse_velocity_to_grid(velocity, velocity_track.velocity.xy(), camera_projection.matrix_inverse(), p);
+		if (fluid.parameters.mac_grid) {
+			// The impulse is computed at the cell centers, and interpolated on the faces
+			fluid.velocity_average.fill({ 0,0 });
+			mouse_velocity_to_grid(fluid.velocity_average, velocity_track.velocity.xy(), camera_projection.matrix_inverse(), p);
+			add_cell_velocity_to_faces(fluid.mac_velocity, fluid.velocity_average);
+		}
+		else
+			mouse_velocity_to_grid(fluid.velocity.front(), velocity_track.velocity.xy(), camera_projection.matrix_inverse(), p);
+		fluid.tiles.full_update = true; // The velocity may have been set in inactive tiles
 	}
 	else {
 		velocity_track.set_record(vec3(p, 0.0f), timer.t);
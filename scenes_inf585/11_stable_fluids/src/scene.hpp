@@ -3,6 +3,7 @@
 
 #include "cgp/cgp.hpp"
 #include "environment.hpp"
+#include "simulation/simulation.hpp"
 
 
 enum density_type_structure { density_color, density_texture, view_velocity_curl };
@@ -11,10 +12,11 @@ enum density_type_structure { density_color, density_texture, view_velocity_curl
 struct gui_parameters {
 	bool display_grid = false;
 	bool display_velocity = false;
-	float diffusion_velocity = 0.001f;
-	float diffusion_density = 0.005f;
 	float velocity_scaling = 1.0f;
 	density_type_structure density_type = density_color;
+	int grid_resolution_x = 60; // Number of cells of the simulation grid (including the border cells)
+	int grid_resolution_y = 60;
+	int velocity_arrows = 64;   // Maximal number of displayed velocity arrows along each direction
 };
 
 // The structure of the custom scene
@@ -37,10 +39,7 @@ struct scene_structure : cgp::scene_inputs_generic {
 	// ****************************** //
 	cgp::timer_basic timer;
 
-	cgp::grid_2D<cgp::vec3> density, density_previous;
-	cgp::grid_2D<cgp::vec2> velocity, velocity_previous;
-	cgp::grid_2D<float> divergence;
-	cgp::grid_2D<float> gradient_field;
+	fluid_2D_structure fluid; // Fields and parameters of the simulation (diffusion, MAC grid, sparse tiles)
 
 	cgp::mesh_drawable density_visual;
 	cgp::curve_drawable grid_visual;
@@ -57,9 +56,9 @@ struct scene_structure : cgp::scene_inputs_generic {
 	void display_frame(); // The frame display to be called within the animation loop
 	void display_gui();   // The display of the GUI, also called within the animation loop
 
-	void simulate(float dt);
-	void initialize_density(density_type_structure density_type, size_t N);
+	void initialize_density(density_type_structure density_type, int Nx, int Ny);
 	void initialize_fields(density_type_structure density_type);
+	void initialize_visuals();
 
 	void mouse_move_event();
 	void mouse_click_event();
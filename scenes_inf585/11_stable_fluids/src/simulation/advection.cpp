@@ -0,0 +1,206 @@
+#include "advection.hpp"
+
+using namespace cgp;
+
+
+void average_velocity(grid_2D<vec2>& velocity_average, grid_2D<vec2> const& velocity)
+{
+    int const Nx = int(velocity.dimension.x);
+    int const Ny = int(velocity.dimension.y);
+    if (int(velocity_average.dimension.x) != Nx || int(velocity_average.dimension.y) != Ny)
+        velocity_average.resize(Nx, Ny);
+    if (Nx < 3 || Ny < 3)
+        return;
+
+    int const stride = 2 * Nx;
+    #pragma omp parallel for schedule(static)
+    for (int y = 1; y < Ny - 1; ++y) {
+        float const* row = &velocity(0, y)[0];
+        float const* row_down = row - stride;
+        float const* row_up = row + stride;
+        float* row_average = &velocity_average(0, y)[0];
+
+        #pragma omp simd
+        for (int k = 2; k < 2 * (Nx - 1); ++k) {
+            float const s_down = row_down[k - 2] + 2.0f * row_down[k] + row_down[k + 2];
+            float const s_center = row[k - 2] + 2.0f * row[k] + row[k + 2];
+            float const s_up = row_up[k - 2] + 2.0f * row_up[k] + row_up[k + 2];
+            row_average[k] = (s_down + 2.0f * s_center + s_up) / 16.0f;
+        }
+    }
+}
+
+
+void average_velocity(grid_2D<vec2>& velocity_average, grid_2D<vec2> const& velocity, sparse_tiles_structure const& tiles)
+{
+    int const Nx = int(velocity.dimension.x);
+    int const Ny = int(velocity.dimension.y);
+    if (int(velocity_average.dimension.x) != Nx || int(velocity_average.dimension.y) != Ny)
+        velocity_average.resize(Nx, Ny);
+    if (Nx < 3 || Ny < 3)
+        return;
+
+    int const stride = 2 * Nx;
+    int const N_tiles = int(tiles.active_tiles.size());
+    #pragma omp parallel for schedule(static)
+    for (int k_tile = 0; k_tile < N_tiles; ++k_tile) {
+        int x_begin, x_end, y_begin, y_end;
+        tiles.tile_range(tiles.active_tiles[k_tile], x_begin, x_end, y_begin, y_end);
+        for (int y = y_begin; y < y_end; ++y) {
+            float const* row = &velocity(0, y)[0];
+            float const* row_down = row - stride;
+            float const* row_up = row + stride;
+            float* row_average = &velocity_average(0, y)[0];
+
+            #pragma omp simd
+            for (int k = 2 * x_begin; k < 2 * x_end; ++k) {
+                float const s_down = row_down[k - 2] + 2.0f * row_down[k] + row_down[k + 2];
+                float const s_center = row[k - 2] + 2.0f * row[k] + row[k + 2];
+                float const s_up = row_up[k - 2] + 2.0f * row_up[k] + row_up[k + 2];
+                row_average[k] = (s_down + 2.0f * s_center + s_up) / 16.0f;
+            }
+        }
+    }
+}
+
+
+// Advection of the cells [x_begin,x_end[ x [y_begin,y_end[ of a field storing D float components per cell (x is the fastest index)
+//  offset, wx, wy are temporary arrays of size at least x_end-x_begin
+template <int D>
+static void advect_tile(float* new_value, float const* value_reference, float const* velocity_average, int Nx, int Ny, float dt, int x_begin, int x_end, int y_begin, int y_end, int* offset, float* wx, float* wy)
+{
+    float const x_max = float(Nx - 1);
+    float const y_max = float(Ny - 1);
+    int const n = x_end - x_begin;
+
+    for (int y = y_begin; y < y_end; ++y) {
+        float const* v = velocity_average + 2 * (y * Nx + x_begin);
+
+        // Back-tracing: position of the sample, its cell, and bilinear weights
+        #pragma omp simd
+        for (int i = 0; i < n; ++i) {
+            float const px = std::min(std::max(float(x_begin + i) - dt * v[2 * i], 0.0f), x_max);
+            float const py = std::min(std::max(float(y) - dt * v[2 * i + 1], 0.0f), y_max);
+            int const x0 = std::min(int(px), Nx - 2);
+            int const y0 = std::min(int(py), Ny - 2);
+            offset[i] = x0 + Nx * y0;
+            wx[i] = px - float(x0);
+            wy[i] = py - float(y0);
+        }
+
+        // Bilinear gathers
+        float* out = new_value + D * (y * Nx + x_begin);
+        #pragma omp simd
+        for (int i = 0; i < n; ++i) {
+            float const* c00 = value_reference + D * offset[i];
+            float const* c10 = c00 + D;
+            float const* c01 = c00 + D * Nx;
+            float const* c11 = c01 + D;
+            float const a = wx[i];
+            float const b = wy[i];
+            for (int d = 0; d < D; ++d) {
+                float const bottom = c00[d] + a * (c10[d] - c00[d]);
+                float const top = c01[d] + a * (c11[d] - c01[d]);
+                out[D * i + d] = bottom + b * (top - bottom);
+            }
+        }
+    }
+}
+
+template <int D>
+static void advect_components(float* new_value, float const* value_reference, float const* velocity_average, int Nx, int Ny, float dt)
+{
+    int const tile_size_x = 64;
+    int const tile_size_y = 16;
+
+    #pragma omp parallel
+    {
+        // Per-row temporary storage of the back-traced samples
+        int offset[tile_size_x];
+        float wx[tile_size_x];
+        float wy[tile_size_x];
+
+        #pragma omp for collapse(2) schedule(static)
+        for (int ty = 1; ty < Ny - 1; ty += tile_size_y) {
+            for (int tx = 1; tx < Nx - 1; tx += tile_size_x) {
+                int const y_end = std::min(ty + tile_size_y, Ny - 1);
+                int const x_end = std::min(tx + tile_size_x, Nx - 1);
+                advect_tile<D>(new_value, value_reference, velocity_average, Nx, Ny, dt, tx, x_end, ty, y_end, offset, wx, wy);
+            }
+        }
+    }
+}
+
+// Advection restricted to the active tiles
+template <int D>
+static void advect_components(float* new_value, float const* value_reference, float const* velocity_average, int Nx, int Ny, float dt, sparse_tiles_structure const& tiles)
+{
+    int const N_tiles = int(tiles.active_tiles.size());
+
+    #pragma omp parallel
+    {
+        int offset[sparse_tiles_structure::tile_size];
+        float wx[sparse_tiles_structure::tile_size];
+        float wy[sparse_tiles_structure::tile_size];
+
+        #pragma omp for schedule(static)
+        for (int k = 0; k < N_tiles; ++k) {
+            int x_begin, x_end, y_begin, y_end;
+            tiles.tile_range(tiles.active_tiles[k], x_begin, x_end, y_begin, y_end);
+            advect_tile<D>(new_value, value_reference, velocity_average, Nx, Ny, dt, x_begin, x_end, y_begin, y_end, offset, wx, wy);
+        }
+    }
+}
+
+template <typename T>
+static void apply_boundary(grid_2D<T>& grid, boundary_condition boundary)
+{
+    if (boundary == copy)
+        set_boundary(grid);
+    else
+        set_boundary_reflective(grid);
+}
+
+void advect_semi_lagrangian(grid_2D<vec2>& new_value, grid_2D<vec2> const& value_reference, grid_2D<vec2> const& velocity_average, float dt, boundary_condition boundary)
+{
+    int const Nx = int(value_reference.dimension.x);
+    int const Ny = int(value_reference.dimension.y);
+    if (Nx < 3 || Ny < 3)
+        return;
+
+    advect_components<2>(&new_value(0, 0)[0], &value_reference(0, 0)[0], &velocity_average(0, 0)[0], Nx, Ny, dt);
+    apply_boundary(new_value, boundary);
+}
+
+void advect_semi_lagrangian(grid_2D<vec3>& new_value, grid_2D<vec3> const& value_reference, grid_2D<vec2> const& velocity_average, float dt, boundary_condition boundary)
+{
+    int const Nx = int(value_reference.dimension.x);
+    int const Ny = int(value_reference.dimension.y);
+    if (Nx < 3 || Ny < 3)
+        return;
+
+    advect_components<3>(&new_value(0, 0)[0], &value_reference(0, 0)[0], &velocity_average(0, 0)[0], Nx, Ny, dt);
+    apply_boundary(new_value, boundary);
+}
+
+void advect_semi_lagrangian(grid_2D<vec2>& new_value, grid_2D<vec2> const& value_reference, grid_2D<vec2> const& velocity_average, float dt, boundary_condition boundary, sparse_tiles_structure const& tiles)
+{
+    int const Nx = int(value_reference.dimension.x);
+    int const Ny = int(value_reference.dimension.y);
+    if (Nx < 3 || Ny < 3)
+        return;
+
+    advect_components<2>(&new_value(0, 0)[0], &value_reference(0, 0)[0], &velocity_average(0, 0)[0], Nx, Ny, dt, tiles);
+    apply_boundary(new_value, boundary);
+}
+
+void advect_semi_lagrangian(grid_2D<vec3>& new_value, grid_2D<vec3> const& value_reference, grid_2D<vec2> const& velocity_average, float dt, boundary_condition boundary, sparse_tiles_structure const& tiles)
+{
+    int const Nx = int(value_reference.dimension.x);
+    int const Ny = int(value_reference.dimension.y);
+    if (Nx < 3 || Ny < 3)
+        return;
+
+    advect_components<3>(&new_value(0, 0)[0], &value_reference(0, 0)[0], &velocity_average(0, 0)[0], Nx, Ny, dt, tiles);
+    apply_boundary(new_value, boundary);
+}
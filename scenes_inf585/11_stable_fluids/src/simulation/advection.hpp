@@ -0,0 +1,25 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+#include "boundary.hpp"
+#include "sparse_tiles.hpp"
+
+
+// Average of the velocity around each interior cell, used as advection velocity to avoid grid artifacts
+//  Equivalent to the mean of the 4 bilinear interpolations at (x+-0.5, y+-0.5), computed as a 3x3 binomial filter [1 2 1; 2 4 2; 1 2 1]/16.
+//  To be computed once per advection step, instead of for every back-traced cell.
+void average_velocity(cgp::grid_2D<cgp::vec2>& velocity_average, cgp::grid_2D<cgp::vec2> const& velocity);
+
+// Semi-Lagrangian advection: new_value(p) = value_reference(p - dt v(p)), with v the averaged velocity
+//  - The cells are processed by tiles in parallel (OpenMP).
+//  - Each row of a tile is processed in two vectorized passes: back-tracing (positions, clamping, bilinear weights), then the bilinear gathers.
+//  - new_value is entirely written (interior cells, then the boundary condition).
+void advect_semi_lagrangian(cgp::grid_2D<cgp::vec2>& new_value, cgp::grid_2D<cgp::vec2> const& value_reference, cgp::grid_2D<cgp::vec2> const& velocity_average, float dt, boundary_condition boundary);
+void advect_semi_lagrangian(cgp::grid_2D<cgp::vec3>& new_value, cgp::grid_2D<cgp::vec3> const& value_reference, cgp::grid_2D<cgp::vec2> const& velocity_average, float dt, boundary_condition boundary);
+
+
+// Same computations restricted to the active tiles (see sparse_tiles.hpp)
+//  The cells of the inactive tiles are not written: the fluid is at rest there, and the field must have the same value in both buffers.
+void average_velocity(cgp::grid_2D<cgp::vec2>& velocity_average, cgp::grid_2D<cgp::vec2> const& velocity, sparse_tiles_structure const& tiles);
+void advect_semi_lagrangian(cgp::grid_2D<cgp::vec2>& new_value, cgp::grid_2D<cgp::vec2> const& value_reference, cgp::grid_2D<cgp::vec2> const& velocity_average, float dt, boundary_condition boundary, sparse_tiles_structure const& tiles);
+void advect_semi_lagrangian(cgp::grid_2D<cgp::vec3>& new_value, cgp::grid_2D<cgp::vec3> const& value_reference, cgp::grid_2D<cgp::vec2> const& velocity_average, float dt, boundary_condition boundary, sparse_tiles_structure const& tiles);
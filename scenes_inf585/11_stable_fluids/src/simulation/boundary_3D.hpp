@@ -0,0 +1,100 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+#include "boundary.hpp"
+
+
+// 3D version of the boundary conditions of boundary.hpp
+//  The border cells take the value of their closest interior cell (faces, edges and corners).
+//  The reflective condition additionally negates the component of the velocity normal to the face.
+template <typename T> void set_boundary(cgp::grid_3D<T>& grid);
+template <typename T> void set_boundary_reflective(cgp::grid_3D<T>& grid);
+
+
+
+
+// Set the border cells of the slab z of the grid (the whole slab if z is a border slab)
+//  sign is applied to the component normal to the face for face cells (the edges and corners are copied only)
+template <typename T>
+void set_boundary_slab(cgp::grid_3D<T>& grid, int z, float sign)
+{
+    int const Nx = int(grid.dimension.x);
+    int const Ny = int(grid.dimension.y);
+    int const Nz = int(grid.dimension.z);
+    int const zc = std::min(std::max(z, 1), Nz - 2);
+
+    if (z == 0 || z == Nz - 1) {
+        for (int y = 0; y < Ny; ++y) {
+            int const yc = std::min(std::max(y, 1), Ny - 2);
+            for (int x = 0; x < Nx; ++x) {
+                int const xc = std::min(std::max(x, 1), Nx - 2);
+                grid(x, y, z) = grid(xc, yc, zc);
+                if (x == xc && y == yc)
+                    grid(x, y, z)[2] *= sign;
+            }
+        }
+        return;
+    }
+
+    for (int x = 0; x < Nx; ++x) {
+        int const xc = std::min(std::max(x, 1), Nx - 2);
+        grid(x, 0, z) = grid(xc, 1, z);
+        grid(x, Ny - 1, z) = grid(xc, Ny - 2, z);
+        if (x == xc) {
+            grid(x, 0, z)[1] *= sign;
+            grid(x, Ny - 1, z)[1] *= sign;
+        }
+    }
+    for (int y = 1; y < Ny - 1; ++y) {
+        grid(0, y, z) = grid(1, y, z);
+        grid(Nx - 1, y, z) = grid(Nx - 2, y, z);
+        grid(0, y, z)[0] *= sign;
+        grid(Nx - 1, y, z)[0] *= sign;
+    }
+}
+
+// Scalar fields have no normal component
+template <>
+inline void set_boundary_slab(cgp::grid_3D<float>& grid, int z, float)
+{
+    int const Nx = int(grid.dimension.x);
+    int const Ny = int(grid.dimension.y);
+    int const Nz = int(grid.dimension.z);
+    int const zc = std::min(std::max(z, 1), Nz - 2);
+
+    bool const border_slab = (z == 0 || z == Nz - 1);
+    for (int y = 0; y < Ny; ++y) {
+        int const yc = std::min(std::max(y, 1), Ny - 2);
+        bool const border_row = border_slab || y == 0 || y == Ny - 1;
+        for (int x = 0; x < Nx; ++x) {
+            if (!border_row && x > 0 && x < Nx - 1)
+                continue;
+            int const xc = std::min(std::max(x, 1), Nx - 2);
+            grid(x, y, z) = grid(xc, yc, zc);
+        }
+    }
+}
+
+
+template <typename T>
+void set_boundary(cgp::grid_3D<T>& grid)
+{
+    int const Nz = int(grid.dimension.z);
+    // The border slabs z=0 and z=Nz-1 read the interior slabs 1 and Nz-2: they are set after the interior slabs
+    #pragma omp parallel for schedule(static)
+    for (int z = 1; z < Nz - 1; ++z)
+        set_boundary_slab(grid, z, 1.0f);
+    set_boundary_slab(grid, 0, 1.0f);
+    set_boundary_slab(grid, Nz - 1, 1.0f);
+}
+
+template <typename T>
+void set_boundary_reflective(cgp::grid_3D<T>& grid)
+{
+    int const Nz = int(grid.dimension.z);
+    #pragma omp parallel for schedule(static)
+    for (int z = 1; z < Nz - 1; ++z)
+        set_boundary_slab(grid, z, -1.0f);
+    set_boundary_slab(grid, 0, -1.0f);
+    set_boundary_slab(grid, Nz - 1, -1.0f);
+}
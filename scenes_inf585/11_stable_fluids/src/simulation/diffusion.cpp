@@ -0,0 +1,190 @@
+#include "diffusion.hpp"
+
+using namespace cgp;
+
+
+// Red-black Gauss-Seidel on a field storing D float components per cell.
+//  The grid is stored with x as the fastest varying index: a row of constant y is a contiguous array of D*Nx floats.
+//  The sweeps are applied on rectangles of interior cells [x_begin,x_end[ x [y_begin,y_end[: the entire interior of the grid, or the active tiles (see sparse_tiles.hpp).
+
+// Initialize the border cells of f adjacent to the rectangle from f_prev
+//  f_prev is used as initial guess without copying it into f: the first half-sweep reads its neighbors in f_prev, and all the interior cells of f are then written before being read.
+template <int D>
+static void initialize_border_from_previous(float* f, float const* f_prev, int Nx, int Ny, int x_begin, int x_end, int y_begin, int y_end)
+{
+    int const stride = D * Nx;
+    int const k_begin = D * ((x_begin == 1) ? 0 : x_begin);
+    int const k_end = D * ((x_end == Nx - 1) ? Nx : x_end);
+
+    if (y_begin == 1)
+        for (int k = k_begin; k < k_end; ++k)
+            f[k] = f_prev[k];
+    if (y_end == Ny - 1)
+        for (int k = k_begin; k < k_end; ++k)
+            f[(Ny - 1) * stride + k] = f_prev[(Ny - 1) * stride + k];
+    for (int y = y_begin; y < y_end; ++y) {
+        for (int d = 0; d < D; ++d) {
+            if (x_begin == 1)
+                f[y * stride + d] = f_prev[y * stride + d];
+            if (x_end == Nx - 1)
+                f[y * stride + D * (Nx - 1) + d] = f_prev[y * stride + D * (Nx - 1) + d];
+        }
+    }
+}
+
+// Half-sweep of one color on the cells [x_begin,x_end[ of the row y
+//  neighbors is f_prev for the first half-sweep, and f otherwise
+template <int D>
+static void diffuse_row_segment(float* f, float const* neighbors, float const* f_prev, int Nx, int Ny, int y, int x_begin, int x_end, int color, float a, float sign)
+{
+    int const stride = D * Nx;
+    float const inv = 1.0f / (1.0f + 4.0f * a);
+
+    float* row = f + y * stride;
+    float const* row_center = neighbors + y * stride;
+    float const* row_down = row_center - stride;
+    float const* row_up = row_center + stride;
+    float const* row_prev = f_prev + y * stride;
+
+    // First x >= x_begin such that (x+y)%2 == color
+    int const x_start = x_begin + ((x_begin + y + color) & 1);
+
+    #pragma omp simd
+    for (int x = x_start; x < x_end; x += 2) {
+        for (int d = 0; d < D; ++d) {
+            int const k = D * x + d;
+            row[k] = (row_prev[k] + a * (row_center[k - D] + row_center[k + D] + row_down[k] + row_up[k])) * inv;
+        }
+    }
+
+    // Fused boundary conditions
+    //  The border cells are only read by their interior neighbor, which is in the same row (left/right),
+    //  or in the row y=1 / y=Ny-2 processed by the same thread (bottom/top): no race condition.
+    if (x_start == 1) {
+        for (int d = 0; d < D; ++d)
+            row[d] = row[D + d];
+        row[0] *= sign;
+    }
+    if (x_end == Nx - 1 && ((Nx - 2 + y) & 1) == color) {
+        for (int d = 0; d < D; ++d)
+            row[D * (Nx - 1) + d] = row[D * (Nx - 2) + d];
+        row[D * (Nx - 1)] *= sign;
+    }
+    if (y == 1 || y == Ny - 2) {
+        float* border = (y == 1) ? f : f + (Ny - 1) * stride;
+        for (int x = x_start; x < x_end; x += 2) {
+            for (int d = 0; d < D; ++d)
+                border[D * x + d] = row[D * x + d];
+            border[D * x + 1] *= sign;
+        }
+        // Corners take the value of their diagonal interior neighbor (same result as set_boundary_corners)
+        if (x_begin == 1)
+            for (int d = 0; d < D; ++d)
+                border[d] = row[D + d];
+        if (x_end == Nx - 1)
+            for (int d = 0; d < D; ++d)
+                border[D * (Nx - 1) + d] = row[D * (Nx - 2) + d];
+    }
+}
+
+template <int D>
+static void diffuse_red_black_components(float* f, float const* f_prev, int Nx, int Ny, float a, int iterations, boundary_condition boundary)
+{
+    float const sign = (boundary == reflective) ? -1.0f : 1.0f; // Sign applied to the normal component on the border
+    initialize_border_from_previous<D>(f, f_prev, Nx, Ny, 1, Nx - 1, 1, Ny - 1);
+
+    #pragma omp parallel
+    for (int k_iteration = 0; k_iteration < iterations; ++k_iteration) {
+        for (int color = 0; color < 2; ++color) {
+            float const* neighbors = (k_iteration == 0 && color == 0) ? f_prev : f;
+
+            #pragma omp for schedule(static)
+            for (int y = 1; y < Ny - 1; ++y)
+                diffuse_row_segment<D>(f, neighbors, f_prev, Nx, Ny, y, 1, Nx - 1, color, a, sign);
+        }
+    }
+}
+
+// Same sweeps restricted to the active tiles
+//  The cells of a color only depend on cells of the other color: the tiles of a half-sweep are processed in parallel.
+template <int D>
+static void diffuse_red_black_components(float* f, float const* f_prev, int Nx, int Ny, float a, int iterations, boundary_condition boundary, sparse_tiles_structure const& tiles)
+{
+    float const sign = (boundary == reflective) ? -1.0f : 1.0f;
+    int const N_tiles = int(tiles.active_tiles.size());
+
+    #pragma omp parallel
+    {
+        #pragma omp for schedule(static)
+        for (int k = 0; k < N_tiles; ++k) {
+            int x_begin, x_end, y_begin, y_end;
+            tiles.tile_range(tiles.active_tiles[k], x_begin, x_end, y_begin, y_end);
+            initialize_border_from_previous<D>(f, f_prev, Nx, Ny, x_begin, x_end, y_begin, y_end);
+        }
+
+        for (int k_iteration = 0; k_iteration < iterations; ++k_iteration) {
+            for (int color = 0; color < 2; ++color) {
+                float const* neighbors = (k_iteration == 0 && color == 0) ? f_prev : f;
+
+                #pragma omp for schedule(static)
+                for (int k = 0; k < N_tiles; ++k) {
+                    int x_begin, x_end, y_begin, y_end;
+                    tiles.tile_range(tiles.active_tiles[k], x_begin, x_end, y_begin, y_end);
+                    for (int y = y_begin; y < y_end; ++y)
+                        diffuse_row_segment<D>(f, neighbors, f_prev, Nx, Ny, y, x_begin, x_end, color, a, sign);
+                }
+            }
+        }
+    }
+}
+
+// The diffusion coefficient is expressed for a unit domain (Stam convention): a = dt mu N^2, with N the largest dimension of the grid
+static float diffusion_coefficient(int Nx, int Ny, float mu, float dt)
+{
+    float const N = float(std::max(Nx, Ny));
+    return dt * mu * N * N;
+}
+
+void diffuse_red_black(grid_2D<vec2>& f, grid_2D<vec2> const& f_prev, float mu, float dt, boundary_condition boundary, int iterations)
+{
+    int const Nx = int(f.dimension.x);
+    int const Ny = int(f.dimension.y);
+    if (Nx < 3 || Ny < 3)
+        return;
+
+    float const a = diffusion_coefficient(Nx, Ny, mu, dt);
+    diffuse_red_black_components<2>(&f(0, 0)[0], &f_prev(0, 0)[0], Nx, Ny, a, iterations, boundary);
+}
+
+void diffuse_red_black(grid_2D<vec3>& f, grid_2D<vec3> const& f_prev, float mu, float dt, boundary_condition boundary, int iterations)
+{
+    int const Nx = int(f.dimension.x);
+    int const Ny = int(f.dimension.y);
+    if (Nx < 3 || Ny < 3)
+        return;
+
+    float const a = diffusion_coefficient(Nx, Ny, mu, dt);
+    diffuse_red_black_components<3>(&f(0, 0)[0], &f_prev(0, 0)[0], Nx, Ny, a, iterations, boundary);
+}
+
+void diffuse_red_black(grid_2D<vec2>& f, grid_2D<vec2> const& f_prev, float mu, float dt, boundary_condition boundary, int iterations, sparse_tiles_structure const& tiles)
+{
+    int const Nx = int(f.dimension.x);
+    int const Ny = int(f.dimension.y);
+    if (Nx < 3 || Ny < 3)
+        return;
+
+    float const a = diffusion_coefficient(Nx, Ny, mu, dt);
+    diffuse_red_black_components<2>(&f(0, 0)[0], &f_prev(0, 0)[0], Nx, Ny, a, iterations, boundary, tiles);
+}
+
+void diffuse_red_black(grid_2D<vec3>& f, grid_2D<vec3> const& f_prev, float mu, float dt, boundary_condition boundary, int iterations, sparse_tiles_structure const& tiles)
+{
+    int const Nx = int(f.dimension.x);
+    int const Ny = int(f.dimension.y);
+    if (Nx < 3 || Ny < 3)
+        return;
+
+    float const a = diffusion_coefficient(Nx, Ny, mu, dt);
+    diffuse_red_black_components<3>(&f(0, 0)[0], &f_prev(0, 0)[0], Nx, Ny, a, iterations, boundary, tiles);
+}
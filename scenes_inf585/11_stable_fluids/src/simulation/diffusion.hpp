@@ -0,0 +1,20 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+#include "boundary.hpp"
+#include "sparse_tiles.hpp"
+
+
+// Solve the implicit diffusion equation (Id - dt mu Laplacian) f = f_prev using red-black ordered Gauss-Seidel sweeps
+//  - The cells (x,y) are split into two colors depending on the parity of x+y. A cell of one color only depends on cells of the other color:
+//    each half-sweep is therefore computed in parallel over the rows (OpenMP), and vectorized along x.
+//  - The boundary condition (copy or reflective) is applied within the sweep, as soon as the neighboring interior cell is updated: no additional pass over the grid is needed.
+//  - f_prev is used as initial guess: the previous content of f is never read, f can therefore be a back buffer (see field_buffer.hpp).
+void diffuse_red_black(cgp::grid_2D<cgp::vec2>& f, cgp::grid_2D<cgp::vec2> const& f_prev, float mu, float dt, boundary_condition boundary, int iterations = 15);
+void diffuse_red_black(cgp::grid_2D<cgp::vec3>& f, cgp::grid_2D<cgp::vec3> const& f_prev, float mu, float dt, boundary_condition boundary, int iterations = 15);
+
+
+// Same diffusion restricted to the active tiles (see sparse_tiles.hpp)
+//  The cells of the inactive tiles are not written: they must have the same value in f and f_prev.
+void diffuse_red_black(cgp::grid_2D<cgp::vec2>& f, cgp::grid_2D<cgp::vec2> const& f_prev, float mu, float dt, boundary_condition boundary, int iterations, sparse_tiles_structure const& tiles);
+void diffuse_red_black(cgp::grid_2D<cgp::vec3>& f, cgp::grid_2D<cgp::vec3> const& f_prev, float mu, float dt, boundary_condition boundary, int iterations, sparse_tiles_structure const& tiles);
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+
+
+// Pair of grids used as front/back buffers for a field of the simulation
+//  Each step of the solver (diffuse, divergence_free, advect) reads the front buffer and writes the entire back buffer.
+//  The two buffers are then exchanged using swap(): no copy of the field is needed between the steps.
+template <typename T>
+struct field_buffer {
+
+    cgp::grid_2D<T> buffer[2];
+    int front_index = 0;
+
+    // Current value of the field
+    cgp::grid_2D<T>& front() { return buffer[front_index]; }
+    cgp::grid_2D<T> const& front() const { return buffer[front_index]; }
+
+    // Buffer to be written by the next step (its content is not meaningful)
+    cgp::grid_2D<T>& back() { return buffer[1 - front_index]; }
+
+    // Exchange the role of the front and back buffers
+    void swap() { front_index = 1 - front_index; }
+
+    // Resize both buffers
+    void resize(int Nx, int Ny) {
+        buffer[0].resize(Nx, Ny);
+        buffer[1].resize(Nx, Ny);
+    }
+
+    // Resize the back buffer to the dimension of the front buffer (to be called when the front buffer is modified externally)
+    void resize_back_to_front() {
+        back().resize(int(front().dimension.x), int(front().dimension.y));
+    }
+};
+
+
+// Front/back buffers for a 3D field (same behavior as field_buffer)
+template <typename T>
+struct field_buffer_3D {
+
+    cgp::grid_3D<T> buffer[2];
+    int front_index = 0;
+
+    cgp::grid_3D<T>& front() { return buffer[front_index]; }
+    cgp::grid_3D<T> const& front() const { return buffer[front_index]; }
+    cgp::grid_3D<T>& back() { return buffer[1 - front_index]; }
+    void swap() { front_index = 1 - front_index; }
+
+    void resize(int Nx, int Ny, int Nz) {
+        buffer[0].resize(Nx, Ny, Nz);
+        buffer[1].resize(Nx, Ny, Nz);
+    }
+};
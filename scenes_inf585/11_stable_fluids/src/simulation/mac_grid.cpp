@@ -0,0 +1,287 @@
+#include "mac_grid.hpp"
+
+using namespace cgp;
+
+
+// Faces of the u grid (axis=0) or of the v grid (axis=1) that are unknowns: all the faces except the walls and the faces outside of the domain
+static void unknown_faces(grid_2D<float> const& f, int axis, int& x_begin, int& x_end, int& y_begin, int& y_end)
+{
+    int const nx = int(f.dimension.x);
+    int const ny = int(f.dimension.y);
+    x_begin = (axis == 0) ? 2 : 1;
+    x_end = (axis == 0) ? nx - 2 : nx - 1;
+    y_begin = (axis == 0) ? 1 : 2;
+    y_end = (axis == 0) ? ny - 1 : ny - 2;
+}
+
+// Zero normal velocity on the walls, and copy of the tangential velocity outside of the domain
+static void set_boundary_faces(grid_2D<float>& f, int axis)
+{
+    int const nx = int(f.dimension.x);
+    int const ny = int(f.dimension.y);
+
+    if (axis == 0) {
+        for (int y = 0; y < ny; ++y) {
+            f(0, y) = 0.0f; f(1, y) = 0.0f;
+            f(nx - 2, y) = 0.0f; f(nx - 1, y) = 0.0f;
+        }
+        for (int x = 2; x < nx - 2; ++x) {
+            f(x, 0) = f(x, 1);
+            f(x, ny - 1) = f(x, ny - 2);
+        }
+    }
+    else {
+        for (int x = 0; x < nx; ++x) {
+            f(x, 0) = 0.0f; f(x, 1) = 0.0f;
+            f(x, ny - 2) = 0.0f; f(x, ny - 1) = 0.0f;
+        }
+        for (int y = 2; y < ny - 2; ++y) {
+            f(0, y) = f(1, y);
+            f(nx - 1, y) = f(nx - 2, y);
+        }
+    }
+}
+
+// Bilinear interpolation of a face grid at the (real valued) index coordinates (x,y), clamped to the grid
+static float interpolate(grid_2D<float> const& f, float x, float y)
+{
+    int const nx = int(f.dimension.x);
+    int const ny = int(f.dimension.y);
+    x = std::min(std::max(x, 0.0f), nx - 1.0f);
+    y = std::min(std::max(y, 0.0f), ny - 1.0f);
+    int const x0 = std::min(int(x), nx - 2);
+    int const y0 = std::min(int(y), ny - 2);
+    float const a = x - x0;
+    float const b = y - y0;
+    float const bottom = f(x0, y0) + a * (f(x0 + 1, y0) - f(x0, y0));
+    float const top = f(x0, y0 + 1) + a * (f(x0 + 1, y0 + 1) - f(x0, y0 + 1));
+    return bottom + b * (top - bottom);
+}
+
+
+void mac_velocity_structure::resize(int Nx, int Ny)
+{
+    u.resize(Nx + 1, Ny);
+    v.resize(Nx, Ny + 1);
+    for (int k = 0; k < 2; ++k) {
+        u.buffer[k].fill(0.0f);
+        v.buffer[k].fill(0.0f);
+    }
+}
+
+
+// Red-black Gauss-Seidel diffusion of one component (same scheme as diffuse_red_black on the cell-centered grid)
+//  f_prev is used as initial guess: its values outside of the unknown faces are copied, and the first half-sweep reads its neighbors in f_prev.
+static void diffuse_faces(grid_2D<float>& f, grid_2D<float> const& f_prev, float a, int iterations, int axis)
+{
+    int const nx = int(f.dimension.x);
+    int const ny = int(f.dimension.y);
+    int x_begin, x_end, y_begin, y_end;
+    unknown_faces(f, axis, x_begin, x_end, y_begin, y_end);
+    float const inv = 1.0f / (1.0f + 4.0f * a);
+
+    for (int y = 0; y < ny; ++y) {
+        for (int x = 0; x < x_begin; ++x)
+            f(x, y) = f_prev(x, y);
+        for (int x = x_end; x < nx; ++x)
+            f(x, y) = f_prev(x, y);
+    }
+    for (int x = x_begin; x < x_end; ++x) {
+        for (int y = 0; y < y_begin; ++y)
+            f(x, y) = f_prev(x, y);
+        for (int y = y_end; y < ny; ++y)
+            f(x, y) = f_prev(x, y);
+    }
+
+    for (int k_iteration = 0; k_iteration < iterations; ++k_iteration) {
+        for (int color = 0; color < 2; ++color) {
+            grid_2D<float> const& neighbors = (k_iteration == 0 && color == 0) ? f_prev : f;
+
+            #pragma omp parallel for schedule(static)
+            for (int y = y_begin; y < y_end; ++y) {
+                int const x_start = x_begin + ((x_begin + y + color) & 1);
+                for (int x = x_start; x < x_end; x += 2)
+                    f(x, y) = (f_prev(x, y) + a * (neighbors(x - 1, y) + neighbors(x + 1, y) + neighbors(x, y - 1) + neighbors(x, y + 1))) * inv;
+            }
+        }
+        // The tangential values outside of the domain are updated once both colors are computed
+        set_boundary_faces(f, axis);
+    }
+}
+
+void diffuse(mac_velocity_structure& velocity, float mu, float dt, int iterations)
+{
+    int const Nx = int(velocity.v.front().dimension.x);
+    int const Ny = int(velocity.u.front().dimension.y);
+    if (Nx < 3 || Ny < 3)
+        return;
+
+    float const N = float(std::max(Nx, Ny));
+    float const a = dt * mu * N * N;
+    diffuse_faces(velocity.u.back(), velocity.u.front(), a, iterations, 0);
+    diffuse_faces(velocity.v.back(), velocity.v.front(), a, iterations, 1);
+    velocity.u.swap();
+    velocity.v.swap();
+}
+
+
+void divergence_free(mac_velocity_structure& velocity, grid_2D<float>& divergence, grid_2D<float>& gradient_field, multigrid_poisson_structure& poisson_solver)
+{
+    // Same projection as the collocated grid: v = v0 - nabla(q), with Laplacian(q) = div(v0)
+    //  The divergence of a cell is the net flux through its 4 faces, and the gradient on a face is the difference of its 2 cells:
+    //  the divergence of the gradient is exactly the 5-points Laplacian solved by the multigrid, and the walls (zero gradient) match its Neumann condition.
+    grid_2D<float> const& u = velocity.u.front();
+    grid_2D<float> const& v = velocity.v.front();
+    int const Nx = int(v.dimension.x);
+    int const Ny = int(u.dimension.y);
+    if (Nx < 3 || Ny < 3)
+        return;
+
+    // 1. Divergence of v0
+    #pragma omp parallel for schedule(static)
+    for (int y = 1; y < Ny - 1; ++y)
+        for (int x = 1; x < Nx - 1; ++x)
+            divergence(x, y) = u(x + 1, y) - u(x, y) + v(x, y + 1) - v(x, y);
+
+    // 2. Solve Laplacian(q) = div(v0)
+    poisson_solver.solve(gradient_field, divergence);
+
+    // 3. v = v0 - nabla(q) on the interior faces
+    grid_2D<float>& new_u = velocity.u.back();
+    grid_2D<float>& new_v = velocity.v.back();
+    #pragma omp parallel for schedule(static)
+    for (int y = 1; y < Ny - 1; ++y) {
+        for (int x = 2; x < Nx - 1; ++x)
+            new_u(x, y) = u(x, y) - (gradient_field(x, y) - gradient_field(x - 1, y));
+    }
+    #pragma omp parallel for schedule(static)
+    for (int y = 2; y < Ny - 1; ++y) {
+        for (int x = 1; x < Nx - 1; ++x)
+            new_v(x, y) = v(x, y) - (gradient_field(x, y) - gradient_field(x, y - 1));
+    }
+    set_boundary_faces(new_u, 0);
+    set_boundary_faces(new_v, 1);
+    velocity.u.swap();
+    velocity.v.swap();
+}
+
+
+void advect(mac_velocity_structure& velocity, float dt)
+{
+    // Semi-Lagrangian advection of each component from its own face position
+    //  The position of u(x,y) is (x-0.5, y), and the position of v(x,y) is (x, y-0.5), in the coordinates of the cells.
+    //  The velocity at a face uses its own component, and the average of the 4 surrounding faces for the other one.
+    grid_2D<float> const& u = velocity.u.front();
+    grid_2D<float> const& v = velocity.v.front();
+    grid_2D<float>& new_u = velocity.u.back();
+    grid_2D<float>& new_v = velocity.v.back();
+    int const Nx = int(v.dimension.x);
+    int const Ny = int(u.dimension.y);
+    if (Nx < 3 || Ny < 3)
+        return;
+
+    float const x_max = Nx - 1.0f;
+    float const y_max = Ny - 1.0f;
+
+    #pragma omp parallel for schedule(static)
+    for (int y = 1; y < Ny - 1; ++y) {
+        for (int x = 2; x < Nx - 1; ++x) {
+            float const vx = u(x, y);
+            float const vy = 0.25f * (v(x - 1, y) + v(x, y) + v(x - 1, y + 1) + v(x, y + 1));
+            float const px = std::min(std::max(x - 0.5f - dt * vx, 0.0f), x_max);
+            float const py = std::min(std::max(y - dt * vy, 0.0f), y_max);
+            new_u(x, y) = interpolate(u, px + 0.5f, py);
+        }
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (int y = 2; y < Ny - 1; ++y) {
+        for (int x = 1; x < Nx - 1; ++x) {
+            float const vx = 0.25f * (u(x, y - 1) + u(x + 1, y - 1) + u(x, y) + u(x + 1, y));
+            float const vy = v(x, y);
+            float const px = std::min(std::max(x - dt * vx, 0.0f), x_max);
+            float const py = std::min(std::max(y - 0.5f - dt * vy, 0.0f), y_max);
+            new_v(x, y) = interpolate(v, px, py + 0.5f);
+        }
+    }
+
+    set_boundary_faces(new_u, 0);
+    set_boundary_faces(new_v, 1);
+    velocity.u.swap();
+    velocity.v.swap();
+}
+
+
+void velocity_at_cell_centers(grid_2D<vec2>& velocity_center, mac_velocity_structure const& velocity)
+{
+    grid_2D<float> const& u = velocity.u.front();
+    grid_2D<float> const& v = velocity.v.front();
+    int const Nx = int(v.dimension.x);
+    int const Ny = int(u.dimension.y);
+    if (int(velocity_center.dimension.x) != Nx || int(velocity_center.dimension.y) != Ny)
+        velocity_center.resize(Nx, Ny);
+
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < Ny; ++y)
+        for (int x = 0; x < Nx; ++x)
+            velocity_center(x, y) = { 0.5f * (u(x, y) + u(x + 1, y)), 0.5f * (v(x, y) + v(x, y + 1)) };
+}
+
+// Set (or add) the interior faces to the average of their two cells
+static void cell_velocity_to_faces(mac_velocity_structure& velocity, grid_2D<vec2> const& velocity_center, bool add)
+{
+    grid_2D<float>& u = velocity.u.front();
+    grid_2D<float>& v = velocity.v.front();
+    int const Nx = int(v.dimension.x);
+    int const Ny = int(u.dimension.y);
+    if (Nx < 3 || Ny < 3)
+        return;
+
+    #pragma omp parallel for schedule(static)
+    for (int y = 1; y < Ny - 1; ++y) {
+        for (int x = 2; x < Nx - 1; ++x) {
+            float const value = 0.5f * (velocity_center(x - 1, y).x + velocity_center(x, y).x);
+            u(x, y) = add ? u(x, y) + value : value;
+        }
+    }
+    #pragma omp parallel for schedule(static)
+    for (int y = 2; y < Ny - 1; ++y) {
+        for (int x = 1; x < Nx - 1; ++x) {
+            float const value = 0.5f * (velocity_center(x, y - 1).y + velocity_center(x, y).y);
+            v(x, y) = add ? v(x, y) + value : value;
+        }
+    }
+    set_boundary_faces(u, 0);
+    set_boundary_faces(v, 1);
+}
+
+void add_cell_velocity_to_faces(mac_velocity_structure& velocity, grid_2D<vec2> const& increment)
+{
+    cell_velocity_to_faces(velocity, increment, true);
+}
+
+void set_faces_from_cell_velocity(mac_velocity_structure& velocity, grid_2D<vec2> const& velocity_center)
+{
+    cell_velocity_to_faces(velocity, velocity_center, false);
+}
+
+
+float divergence_norm(mac_velocity_structure const& velocity)
+{
+    grid_2D<float> const& u = velocity.u.front();
+    grid_2D<float> const& v = velocity.v.front();
+    int const Nx = int(v.dimension.x);
+    int const Ny = int(u.dimension.y);
+    if (Nx < 3 || Ny < 3)
+        return 0.0f;
+
+    double sum = 0.0;
+    #pragma omp parallel for reduction(+:sum) schedule(static)
+    for (int y = 1; y < Ny - 1; ++y) {
+        for (int x = 1; x < Nx - 1; ++x) {
+            double const d = u(x + 1, y) - u(x, y) + v(x, y + 1) - v(x, y);
+            sum += d * d;
+        }
+    }
+    return float(std::sqrt(sum / (double(Nx - 2) * double(Ny - 2))));
+}
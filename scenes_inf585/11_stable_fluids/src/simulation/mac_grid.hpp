@@ -0,0 +1,37 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+#include "field_buffer.hpp"
+#include "multigrid.hpp"
+
+
+// Staggered (MAC) storage of the velocity for a grid of Nx x Ny cells (including the border cells)
+//  - u(x,y) is the x-component of the velocity on the face between the cells (x-1,y) and (x,y): u has (Nx+1) x Ny values.
+//  - v(x,y) is the y-component of the velocity on the face between the cells (x,y-1) and (x,y): v has Nx x (Ny+1) values.
+//  - The walls are the faces between the border cells and the interior cells (u(1,y), u(Nx-1,y), v(x,1), v(x,Ny-1)): their normal velocity is zero.
+//    The tangential components outside of the domain (u(x,0), u(x,Ny-1), v(0,y), v(Nx-1,y)) copy their interior neighbor (free slip).
+//
+//  The divergence of a cell and the pressure gradient on a face are exact finite differences of the neighboring values:
+//   the projection is exact up to the residual of the Poisson solver, without the checkerboard artifacts of the collocated grid.
+//  Each component is advected using a single bilinear interpolation in its own grid.
+struct mac_velocity_structure {
+    field_buffer<float> u;
+    field_buffer<float> v;
+
+    // Allocate the faces for a grid of Nx x Ny cells, with a zero velocity
+    void resize(int Nx, int Ny);
+};
+
+// Each step reads the front buffers of the velocity, writes the back buffers, and swaps them
+//  The back-tracing of advect is computed in cells: for a velocity in world units, dt is the time step divided by the size of a cell
+void diffuse(mac_velocity_structure& velocity, float mu, float dt, int iterations = 15);
+void divergence_free(mac_velocity_structure& velocity, cgp::grid_2D<float>& divergence, cgp::grid_2D<float>& gradient_field, multigrid_poisson_structure& poisson_solver);
+void advect(mac_velocity_structure& velocity, float dt);
+
+// Conversions between the staggered and the cell-centered velocity (used for the advection of the density, the display, and the mouse interaction)
+void velocity_at_cell_centers(cgp::grid_2D<cgp::vec2>& velocity_center, mac_velocity_structure const& velocity);
+void add_cell_velocity_to_faces(mac_velocity_structure& velocity, cgp::grid_2D<cgp::vec2> const& increment);
+void set_faces_from_cell_velocity(mac_velocity_structure& velocity, cgp::grid_2D<cgp::vec2> const& velocity_center);
+
+// Discrete divergence of the staggered velocity on the interior cells (RMS norm)
+float divergence_norm(mac_velocity_structure const& velocity);
@@ -0,0 +1,405 @@
+#include "multigrid.hpp"
+#include "boundary.hpp"
+#include "boundary_3D.hpp"
+
+using namespace cgp;
+
+
+// Interior rows of a 2D (D=2) or 3D (D=3) grid, x being the fastest index
+//  The row k gathers the cells x in [1,Nx-1[ of the line y = 1 + k%ny, z = 1 + k/ny (z = 0 for a 2D grid), with ny = Ny-2.
+//  neighbor[d] is the offset between a cell and its neighbor along y (d=0) and z (d=1).
+//  The kernels written on the rows (relaxation, residual, norms) are common to both dimensions.
+template <int D>
+struct interior_rows {
+    static int const dimension = D;
+    int Nx;
+    int ny;
+    int count;  // Number of interior rows
+    int neighbor[D - 1];
+
+    int y(int k) const { return 1 + k % ny; }
+    int z(int k) const { return D == 3 ? 1 + k / ny : 0; }
+    int offset(int k) const { return Nx * (y(k) + (ny + 2) * z(k)); } // Offset of the cell x=0 of the row k
+};
+
+static interior_rows<2> rows_of(grid_2D<float> const& g)
+{
+    interior_rows<2> rows;
+    rows.Nx = int(g.dimension.x);
+    rows.ny = int(g.dimension.y) - 2;
+    rows.count = rows.ny;
+    rows.neighbor[0] = rows.Nx;
+    return rows;
+}
+
+static interior_rows<3> rows_of(grid_3D<float> const& g)
+{
+    interior_rows<3> rows;
+    rows.Nx = int(g.dimension.x);
+    rows.ny = int(g.dimension.y) - 2;
+    rows.count = rows.ny * (int(g.dimension.z) - 2);
+    rows.neighbor[0] = rows.Nx;
+    rows.neighbor[1] = rows.Nx * int(g.dimension.y);
+    return rows;
+}
+
+
+// Red-black Gauss-Seidel sweeps on Laplacian(q) = b, with a grid spacing h (h2=h*h)
+template <typename grid_type>
+static void smooth_red_black(grid_type& q, grid_type const& b, float h2, int iterations)
+{
+    auto const rows = rows_of(q);
+    int const D = decltype(rows)::dimension;
+    int const Nx = rows.Nx;
+    float const inv_diagonal = 1.0f / (2 * D);
+    float* const data = &q.data[0];
+    float const* const data_b = &b.data[0];
+    for (int k_iteration = 0; k_iteration < iterations; ++k_iteration) {
+        for (int color = 0; color < 2; ++color) {
+            #pragma omp parallel for schedule(static)
+            for (int k = 0; k < rows.count; ++k) {
+                float* row = data + rows.offset(k);
+                float const* row_b = data_b + rows.offset(k);
+                int const x_start = 1 + ((1 + rows.y(k) + rows.z(k) + color) & 1);
+                for (int x = x_start; x < Nx - 1; x += 2) {
+                    float sum = row[x - 1] + row[x + 1];
+                    for (int d = 0; d < D - 1; ++d)
+                        sum += row[x - rows.neighbor[d]] + row[x + rows.neighbor[d]];
+                    row[x] = inv_diagonal * (sum - h2 * row_b[x]);
+                }
+            }
+            set_boundary(q);
+        }
+    }
+}
+
+// Compute r = b - Laplacian(q) on the interior cells (the border of r is never written: it stays at 0 from its allocation)
+//  Returns the sum of the squared residual values
+template <typename grid_type>
+static double compute_residual(grid_type& r, grid_type const& q, grid_type const& b, float h2)
+{
+    auto const rows = rows_of(q);
+    int const D = decltype(rows)::dimension;
+    int const Nx = rows.Nx;
+    float const inv_h2 = 1.0f / h2;
+    float* const data_r = &r.data[0];
+    float const* const data = &q.data[0];
+    float const* const data_b = &b.data[0];
+    double sum = 0.0;
+    #pragma omp parallel for schedule(static) reduction(+:sum)
+    for (int k = 0; k < rows.count; ++k) {
+        float* row_r = data_r + rows.offset(k);
+        float const* row = data + rows.offset(k);
+        float const* row_b = data_b + rows.offset(k);
+        float sum_row = 0.0f;
+        #pragma omp simd reduction(+:sum_row)
+        for (int x = 1; x < Nx - 1; ++x) {
+            float neighbors = row[x - 1] + row[x + 1];
+            for (int d = 0; d < D - 1; ++d)
+                neighbors += row[x - rows.neighbor[d]] + row[x + rows.neighbor[d]];
+            float const value = row_b[x] - (neighbors - 2 * D * row[x]) * inv_h2;
+            row_r[x] = value;
+            sum_row += value * value;
+        }
+        sum += sum_row;
+    }
+    return sum;
+}
+
+// Sum of the squared values over the interior cells
+template <typename grid_type>
+static double squared_norm_interior(grid_type const& g)
+{
+    auto const rows = rows_of(g);
+    float const* const data = &g.data[0];
+    double sum = 0.0;
+    #pragma omp parallel for schedule(static) reduction(+:sum)
+    for (int k = 0; k < rows.count; ++k) {
+        float const* row = data + rows.offset(k);
+        float sum_row = 0.0f;
+        #pragma omp simd reduction(+:sum_row)
+        for (int x = 1; x < rows.Nx - 1; ++x)
+            sum_row += row[x] * row[x];
+        sum += sum_row;
+    }
+    return sum;
+}
+
+// Number of interior cells
+template <typename grid_type>
+static double interior_size(grid_type const& g)
+{
+    auto const rows = rows_of(g);
+    return double(rows.count) * double(rows.Nx - 2);
+}
+
+// Shift the interior values of g such that their mean is zero
+template <typename grid_type>
+static void remove_mean_interior(grid_type& g)
+{
+    auto const rows = rows_of(g);
+    float* const data = &g.data[0];
+    double sum = 0.0;
+    #pragma omp parallel for schedule(static) reduction(+:sum)
+    for (int k = 0; k < rows.count; ++k) {
+        float const* row = data + rows.offset(k);
+        float sum_row = 0.0f;
+        #pragma omp simd reduction(+:sum_row)
+        for (int x = 1; x < rows.Nx - 1; ++x)
+            sum_row += row[x];
+        sum += sum_row;
+    }
+    float const mean = float(sum / interior_size(g));
+
+    #pragma omp parallel for schedule(static)
+    for (int k = 0; k < rows.count; ++k) {
+        float* row = data + rows.offset(k);
+        #pragma omp simd
+        for (int x = 1; x < rows.Nx - 1; ++x)
+            row[x] -= mean;
+    }
+}
+
+
+// Transfers between the levels, specific to each dimension
+//  The interior cell X of a coarse grid covers the fine interior cells 2X-1 and 2X along each direction.
+
+// Allocate the coarse grid of a fine grid: (n+1)/2 interior cells along each direction
+static void resize_coarse(grid_2D<float>& coarse, grid_2D<float> const& fine)
+{
+    coarse.resize((int(fine.dimension.x) - 1) / 2 + 2, (int(fine.dimension.y) - 1) / 2 + 2);
+    coarse.fill(0.0f);
+}
+
+static void resize_coarse(grid_3D<float>& coarse, grid_3D<float> const& fine)
+{
+    coarse.resize((int(fine.dimension.x) - 1) / 2 + 2, (int(fine.dimension.y) - 1) / 2 + 2, (int(fine.dimension.z) - 1) / 2 + 2);
+    coarse.fill(0.0f);
+}
+
+// Smallest number of interior cells along a direction
+static int interior_size_min(grid_2D<float> const& g)
+{
+    return std::min(int(g.dimension.x), int(g.dimension.y)) - 2;
+}
+
+static int interior_size_min(grid_3D<float> const& g)
+{
+    return std::min(int(g.dimension.x), std::min(int(g.dimension.y), int(g.dimension.z))) - 2;
+}
+
+static bool same_dimension(grid_2D<float> const& a, grid_2D<float> const& b)
+{
+    return a.dimension.x == b.dimension.x && a.dimension.y == b.dimension.y;
+}
+
+static bool same_dimension(grid_3D<float> const& a, grid_3D<float> const& b)
+{
+    return a.dimension.x == b.dimension.x && a.dimension.y == b.dimension.y && a.dimension.z == b.dimension.z;
+}
+
+// Restriction of the fine residual to the coarse right-hand side
+//  The value of a coarse cell is the average of its children.
+static void restrict_residual(grid_2D<float>& b_coarse, grid_2D<float> const& r_fine)
+{
+    int const Nx_f = int(r_fine.dimension.x);
+    int const Ny_f = int(r_fine.dimension.y);
+    int const Nx_c = int(b_coarse.dimension.x);
+    int const Ny_c = int(b_coarse.dimension.y);
+
+    #pragma omp parallel for schedule(static)
+    for (int Y = 1; Y < Ny_c - 1; ++Y) {
+        int const y0 = 2 * Y - 1;
+        int const y1 = std::min(2 * Y, Ny_f - 2);
+        float const* row_0 = &r_fine(0, y0);
+        float const* row_1 = &r_fine(0, y1);
+        float* row_c = &b_coarse(0, Y);
+        for (int X = 1; X < Nx_c - 1; ++X) {
+            int const x0 = 2 * X - 1;
+            int const x1 = std::min(2 * X, Nx_f - 2);
+            row_c[X] = 0.25f * (row_0[x0] + row_0[x1] + row_1[x0] + row_1[x1]);
+        }
+    }
+    set_boundary(b_coarse);
+}
+
+static void restrict_residual(grid_3D<float>& b_coarse, grid_3D<float> const& r_fine)
+{
+    int const Nx_f = int(r_fine.dimension.x);
+    int const Ny_f = int(r_fine.dimension.y);
+    int const Nz_f = int(r_fine.dimension.z);
+    int const Nx_c = int(b_coarse.dimension.x);
+    int const Ny_c = int(b_coarse.dimension.y);
+    int const Nz_c = int(b_coarse.dimension.z);
+
+    #pragma omp parallel for schedule(static)
+    for (int Z = 1; Z < Nz_c - 1; ++Z) {
+        int const z0 = 2 * Z - 1;
+        int const z1 = std::min(2 * Z, Nz_f - 2);
+        for (int Y = 1; Y < Ny_c - 1; ++Y) {
+            int const y0 = 2 * Y - 1;
+            int const y1 = std::min(2 * Y, Ny_f - 2);
+            float const* row_00 = &r_fine(0, y0, z0);
+            float const* row_10 = &r_fine(0, y1, z0);
+            float const* row_01 = &r_fine(0, y0, z1);
+            float const* row_11 = &r_fine(0, y1, z1);
+            float* row_c = &b_coarse(0, Y, Z);
+            for (int X = 1; X < Nx_c - 1; ++X) {
+                int const x0 = 2 * X - 1;
+                int const x1 = std::min(2 * X, Nx_f - 2);
+                row_c[X] = 0.125f * (row_00[x0] + row_00[x1] + row_10[x0] + row_10[x1] + row_01[x0] + row_01[x1] + row_11[x0] + row_11[x1]);
+            }
+        }
+    }
+    set_boundary(b_coarse);
+}
+
+// Bilinear (2D) or trilinear (3D) interpolation of the coarse correction e, added to the fine solution q
+//  A fine cell is interpolated from its parent cell (weight 3/4) and the closest neighboring coarse cell (weight 1/4) in each direction.
+//  The ghost cells of e must satisfy the boundary condition.
+static void prolongate_add(grid_2D<float>& q_fine, grid_2D<float> const& e_coarse)
+{
+    int const Nx_f = int(q_fine.dimension.x);
+    int const Ny_f = int(q_fine.dimension.y);
+
+    #pragma omp parallel for schedule(static)
+    for (int y = 1; y < Ny_f - 1; ++y) {
+        int const Y = (y + 1) / 2;
+        int const Y_neighbor = (y & 1) ? Y - 1 : Y + 1;
+        float const* row_c = &e_coarse(0, Y);
+        float const* row_n = &e_coarse(0, Y_neighbor);
+        float* row_f = &q_fine(0, y);
+        for (int x = 1; x < Nx_f - 1; ++x) {
+            int const X = (x + 1) / 2;
+            int const X_neighbor = (x & 1) ? X - 1 : X + 1;
+            row_f[x] += 0.5625f * row_c[X] + 0.1875f * (row_c[X_neighbor] + row_n[X]) + 0.0625f * row_n[X_neighbor];
+        }
+    }
+    set_boundary(q_fine);
+}
+
+static void prolongate_add(grid_3D<float>& q_fine, grid_3D<float> const& e_coarse)
+{
+    int const Nx_f = int(q_fine.dimension.x);
+    int const Ny_f = int(q_fine.dimension.y);
+    int const Nz_f = int(q_fine.dimension.z);
+
+    #pragma omp parallel for schedule(static)
+    for (int z = 1; z < Nz_f - 1; ++z) {
+        int const Z = (z + 1) / 2;
+        int const Z_neighbor = (z & 1) ? Z - 1 : Z + 1;
+        for (int y = 1; y < Ny_f - 1; ++y) {
+            int const Y = (y + 1) / 2;
+            int const Y_neighbor = (y & 1) ? Y - 1 : Y + 1;
+            float const* row_c = &e_coarse(0, Y, Z);         // parent row
+            float const* row_y = &e_coarse(0, Y_neighbor, Z); // neighbor in y
+            float const* row_z = &e_coarse(0, Y, Z_neighbor); // neighbor in z
+            float const* row_yz = &e_coarse(0, Y_neighbor, Z_neighbor);
+            float* row_f = &q_fine(0, y, z);
+            for (int x = 1; x < Nx_f - 1; ++x) {
+                int const X = (x + 1) / 2;
+                int const X_neighbor = (x & 1) ? X - 1 : X + 1;
+                row_f[x] += 0.421875f * row_c[X]
+                    + 0.140625f * (row_c[X_neighbor] + row_y[X] + row_z[X])
+                    + 0.046875f * (row_y[X_neighbor] + row_z[X_neighbor] + row_yz[X])
+                    + 0.015625f * row_yz[X_neighbor];
+            }
+        }
+    }
+    set_boundary(q_fine);
+}
+
+
+template <typename grid_type>
+void multigrid_solver_structure<grid_type>::initialize(grid_type const& q)
+{
+    levels.clear();
+
+    level_structure finest;
+    finest.h2 = 1.0f;
+    finest.residual = q;
+    finest.residual.fill(0.0f);
+    levels.push_back(finest);
+
+    // Stop the coarsening when the grid is small enough to be solved directly by relaxation
+    while (interior_size_min(levels.back().residual) > 4) {
+        level_structure coarse;
+        coarse.h2 = 4.0f * levels.back().h2;
+        resize_coarse(coarse.residual, levels.back().residual);
+        coarse.solution = coarse.residual;
+        coarse.rhs = coarse.residual;
+        levels.push_back(coarse);
+    }
+    statistics = multigrid_statistics();
+    statistics.levels = int(levels.size());
+}
+
+template <typename grid_type>
+void multigrid_solver_structure<grid_type>::v_cycle(int level, grid_type& q, grid_type const& b)
+{
+    level_structure& current = levels[level];
+
+    // Coarsest level: solve using relaxation only
+    if (level == int(levels.size()) - 1) {
+        smooth_red_black(q, b, current.h2, parameters.coarse_iterations);
+        return;
+    }
+
+    // Pre-smoothing
+    smooth_red_black(q, b, current.h2, parameters.pre_smoothing);
+
+    // Coarse grid correction
+    level_structure& coarse = levels[level + 1];
+    compute_residual(current.residual, q, b, current.h2);
+    restrict_residual(coarse.rhs, current.residual);
+    remove_mean_interior(coarse.rhs);
+    coarse.solution.fill(0.0f);
+    v_cycle(level + 1, coarse.solution, coarse.rhs);
+    prolongate_add(q, coarse.solution);
+
+    // Post-smoothing
+    smooth_red_black(q, b, current.h2, parameters.post_smoothing);
+}
+
+template <typename grid_type>
+void multigrid_solver_structure<grid_type>::solve(grid_type& q, grid_type& rhs)
+{
+    if (levels.size() == 0 || !same_dimension(levels[0].residual, q))
+        initialize(q);
+
+    statistics.cycles = 0;
+    statistics.converged = false;
+
+    double const N_interior = interior_size(q);
+    remove_mean_interior(rhs);
+    statistics.rhs_norm = float(std::sqrt(squared_norm_interior(rhs) / N_interior));
+    set_boundary(q);
+
+    float residual = float(std::sqrt(compute_residual(levels[0].residual, q, rhs, 1.0f) / N_interior));
+    statistics.residual_initial = residual;
+
+    // The absolute lower bound avoids useless cycles on a quiescent field (rhs=0)
+    float const threshold = std::max(parameters.tolerance * statistics.rhs_norm, 1e-7f);
+    while (residual > threshold && statistics.cycles < parameters.max_cycles) {
+        v_cycle(0, q, rhs);
+        float const residual_previous = residual;
+        residual = float(std::sqrt(compute_residual(levels[0].residual, q, rhs, 1.0f) / N_interior));
+        statistics.cycles++;
+
+        // Stop if the residual stagnates: the floating point precision of q is reached (large grids and strict tolerance)
+        if (residual > parameters.stagnation_ratio * residual_previous)
+            break;
+    }
+
+    statistics.residual_final = residual;
+    statistics.converged = (residual <= threshold);
+    if (statistics.cycles > 0 && statistics.residual_initial > 0)
+        statistics.convergence_factor = std::pow(residual / statistics.residual_initial, 1.0f / statistics.cycles);
+    else
+        statistics.convergence_factor = 0.0f;
+}
+
+
+// The solver is compiled for the 2D and 3D grids
+template struct multigrid_solver_structure<grid_2D<float>>;
+template struct multigrid_solver_structure<grid_3D<float>>;
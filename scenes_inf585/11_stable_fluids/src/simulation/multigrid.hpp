@@ -0,0 +1,63 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+
+
+// Parameters of the multigrid Poisson solver
+struct multigrid_parameters {
+    float tolerance = 1e-3f;   // The solver stops when ||residual|| < tolerance * ||rhs|| (RMS norms)
+    int max_cycles = 20;       // Maximal number of V-cycles per solve
+    int pre_smoothing = 2;     // Red-black Gauss-Seidel sweeps before the coarse grid correction
+    int post_smoothing = 2;    // Red-black Gauss-Seidel sweeps after the coarse grid correction
+    int coarse_iterations = 30; // Gauss-Seidel sweeps used as a solver on the coarsest level
+    float stagnation_ratio = 0.7f; // The solver stops if a V-cycle reduces the residual by less than this ratio
+};
+
+// Convergence statistics filled by the last call to solve()
+struct multigrid_statistics {
+    int levels = 0;                 // Number of levels in the hierarchy
+    int cycles = 0;                 // Number of V-cycles performed
+    float residual_initial = 0.0f;  // RMS norm of the residual before the first cycle
+    float residual_final = 0.0f;    // RMS norm of the residual after the last cycle
+    float rhs_norm = 0.0f;          // RMS norm of the right-hand side
+    float convergence_factor = 0.0f; // Average reduction of the residual per V-cycle
+    bool converged = false;         // True if the tolerance has been reached
+};
+
+// Geometric multigrid solver (V-cycle) of the Poisson equation: Laplacian(q) = rhs
+//  grid_type is cgp::grid_2D<float> or cgp::grid_3D<float>.
+//  - The Laplacian is the standard 5-points (2D) or 7-points (3D) stencil with unit grid spacing on the finest level.
+//  - The border cells of the grids are ghost cells satisfying a Neumann condition (same behavior as set_boundary).
+//  - Each level halves the number of interior cells in each direction. The cost of a V-cycle is therefore linear in the number of cells,
+//    and the number of cycles needed to reach a given tolerance is independent of the grid size.
+//  The levels, the V-cycle and the stopping criteria are common to both dimensions: only the transfers between the levels depend on it (see multigrid.cpp).
+template <typename grid_type>
+struct multigrid_solver_structure {
+
+    multigrid_parameters parameters;
+    multigrid_statistics statistics;
+
+    // Temporary buffers of a level of the hierarchy
+    //  The level 0 uses the solution and right-hand side given to solve(), only its residual is stored here.
+    struct level_structure {
+        grid_type solution;
+        grid_type rhs;
+        grid_type residual;
+        float h2; // squared grid spacing of this level
+    };
+    std::vector<level_structure> levels;
+
+    // Allocate the hierarchy for a grid q (including the border cells), its content is not used
+    void initialize(grid_type const& q);
+
+    // Solve Laplacian(q) = rhs using q as initial guess
+    //  rhs is shifted in place to have a zero mean (compatibility condition of the Neumann problem)
+    void solve(grid_type& q, grid_type& rhs);
+
+    // Apply one V-cycle on the given level of the hierarchy (recursive call to the coarser levels)
+    void v_cycle(int level, grid_type& q, grid_type const& b);
+};
+
+// Solvers of the projection step of the 2D and 3D fluids
+using multigrid_poisson_structure = multigrid_solver_structure<cgp::grid_2D<float>>;
+using multigrid_poisson_3D_structure = multigrid_solver_structure<cgp::grid_3D<float>>;
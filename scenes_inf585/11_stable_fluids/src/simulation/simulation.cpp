@@ -1,10 +1,12 @@
 #include "simulation.hpp"
 
+#include <chrono>
+
 using namespace cgp;
 
 
 
-void divergence_free(grid_2D<vec2>& new_velocity, grid_2D<vec2> const& velocity, grid_2D<float>& divergence, grid_2D<float>& gradient_field)
+void divergence_free(grid_2D<vec2>& new_velocity, grid_2D<vec2> const& velocity, grid_2D<float>& divergence, grid_2D<float>& gradient_field, multigrid_poisson_structure& poisson_solver)
 {
     // v = projection of v0 on divergence free vector field
     //
@@ -12,11 +14,194 @@ void divergence_free(grid_2D<vec2>& new_velocity, grid_2D<vec2> const& velocity,
     // v0: Initial vector field (non divergence free)
     // divergence: temporary buffer used to compute the divergence of v0
     // gradient_field: temporary buffer used to compute v = v0 - nabla(gradient_field)
+    //                 its previous content is used as initial guess of the Poisson solver
+    // poisson_solver: multigrid solver of the Poisson equation (stores its convergence statistics)
 
+    int const Nx = int(velocity.dimension.x);
+    int const Ny = int(velocity.dimension.y);
 
-    // TO do:
     // 1. Compute divergence of v0
+    #pragma omp parallel for schedule(static)
+    for (int y = 1; y < Ny - 1; ++y) {
+        for (int x = 1; x < Nx - 1; ++x)
+            divergence(x, y) = 0.5f * (velocity(x + 1, y).x - velocity(x - 1, y).x + velocity(x, y + 1).y - velocity(x, y - 1).y);
+    }
+
     // 2. Compute gradient_field such that nabla(gradient_field)^2 = div(v0)
+    poisson_solver.solve(gradient_field, divergence);
+
     // 3. Compute v = v0 - nabla(gradient_field)
+    #pragma omp parallel for schedule(static)
+    for (int y = 1; y < Ny - 1; ++y) {
+        for (int x = 1; x < Nx - 1; ++x) {
+            vec2 const grad = 0.5f * vec2(gradient_field(x + 1, y) - gradient_field(x - 1, y), gradient_field(x, y + 1) - gradient_field(x, y - 1));
+            new_velocity(x, y) = velocity(x, y) - grad;
+        }
+    }
+    set_boundary_reflective(new_velocity);
+}
+
+void divergence_free(grid_2D<vec2>& new_velocity, grid_2D<vec2> const& velocity, grid_2D<float>& divergence, grid_2D<float>& gradient_field, multigrid_poisson_structure& poisson_solver, sparse_tiles_structure const& tiles)
+{
+    // Same projection as above, the divergence and the gradient are only computed on the active tiles
+    //  The divergence is zero in the inactive tiles (the fluid is at rest). It is reset on the entire grid since the solver shifts it in place.
+    int const N_tiles = int(tiles.active_tiles.size());
+    divergence.fill(0.0f);
+
+    #pragma omp parallel for schedule(static)
+    for (int k = 0; k < N_tiles; ++k) {
+        int x_begin, x_end, y_begin, y_end;
+        tiles.tile_range(tiles.active_tiles[k], x_begin, x_end, y_begin, y_end);
+        for (int y = y_begin; y < y_end; ++y)
+            for (int x = x_begin; x < x_end; ++x)
+                divergence(x, y) = 0.5f * (velocity(x + 1, y).x - velocity(x - 1, y).x + velocity(x, y + 1).y - velocity(x, y - 1).y);
+    }
+
+    poisson_solver.solve(gradient_field, divergence);
+
+    // The velocity of the inactive tiles remains zero: the pressure gradient only acts on the active region
+    #pragma omp parallel for schedule(static)
+    for (int k = 0; k < N_tiles; ++k) {
+        int x_begin, x_end, y_begin, y_end;
+        tiles.tile_range(tiles.active_tiles[k], x_begin, x_end, y_begin, y_end);
+        for (int y = y_begin; y < y_end; ++y) {
+            for (int x = x_begin; x < x_end; ++x) {
+                vec2 const grad = 0.5f * vec2(gradient_field(x + 1, y) - gradient_field(x - 1, y), gradient_field(x, y + 1) - gradient_field(x, y - 1));
+                new_velocity(x, y) = velocity(x, y) - grad;
+            }
+        }
+    }
+    set_boundary_reflective(new_velocity);
+}
+
+float divergence_norm(grid_2D<vec2> const& velocity)
+{
+    int const Nx = int(velocity.dimension.x);
+    int const Ny = int(velocity.dimension.y);
+    double sum = 0.0;
+    #pragma omp parallel for reduction(+:sum) schedule(static)
+    for (int y = 1; y < Ny - 1; ++y) {
+        for (int x = 1; x < Nx - 1; ++x) {
+            double const d = 0.5 * (velocity(x + 1, y).x - velocity(x - 1, y).x + velocity(x, y + 1).y - velocity(x, y - 1).y);
+            sum += d * d;
+        }
+    }
+    return float(std::sqrt(sum / (double(Nx - 2) * double(Ny - 2))));
+}
+
+
+
+void fluid_2D_structure::initialize(int Nx, int Ny, float cell_size_arg)
+{
+    cell_size = cell_size_arg;
+    velocity.resize(Nx, Ny);
+    velocity.front().fill({ 0,0 });
+    mac_velocity.resize(Nx, Ny);
+    density.resize(Nx, Ny);
+    divergence.clear(); divergence.resize(Nx, Ny);
+    gradient_field.clear(); gradient_field.resize(Nx, Ny);
+    velocity_average.clear(); velocity_average.resize(Nx, Ny);
+    pressure_solver.initialize(gradient_field);
+    tiles.initialize(Nx, Ny);
+}
+
+static float elapsed_ms(std::chrono::steady_clock::time_point const& t0, std::chrono::steady_clock::time_point const& t1)
+{
+    return std::chrono::duration<float, std::milli>(t1 - t0).count();
+}
+
+void fluid_2D_structure::simulate(float dt)
+{
+    // Each step reads the front buffer and writes the back buffer, the buffers are then swapped (no copy of the fields)
+    //  The velocity is stored in world units: the back-tracing of the advection is converted in cells (dt/h, h being the size of a cell)
+    float const dt_cells = dt / cell_size;
+    float const mu_velocity = parameters.diffusion_velocity;
+    float const mu_density = parameters.diffusion_density;
+    int const iterations = parameters.diffusion_iterations;
+    bool const mac = parameters.mac_grid;
+    bool const sparse = !mac && parameters.sparse_tiles;
+
+    auto const t_start = std::chrono::steady_clock::now();
+    if (sparse) {
+        // The tiles where the fluid stopped moving are retired: they are put at rest in both buffers, and are not computed anymore
+        bool const track_density = parameters.advect_density && mu_density > 0;
+        if (track_density != tiles.track_density) {
+            tiles.track_density = track_density;
+            tiles.full_update = true; // The resting tiles may now have to be activated
+        }
+        tiles.update(velocity.front(), density.front());
+        retire_tiles(velocity, tiles, true);
+        retire_tiles(density, tiles, false);
+    }
+    auto const t0 = std::chrono::steady_clock::now();
+
+    // velocity
+    if (mac)
+        diffuse(mac_velocity, mu_velocity, dt, iterations);
+    else if (sparse) {
+        diffuse_red_black(velocity.back(), velocity.front(), mu_velocity, dt, reflective, iterations, tiles); velocity.swap();
+    }
+    else {
+        diffuse_red_black(velocity.back(), velocity.front(), mu_velocity, dt, reflective, iterations); velocity.swap();
+    }
+    auto const t1 = std::chrono::steady_clock::now();
+
+    if (mac)
+        divergence_free(mac_velocity, divergence, gradient_field, pressure_solver);
+    else if (sparse) {
+        divergence_free(velocity.back(), velocity.front(), divergence, gradient_field, pressure_solver, tiles); velocity.swap();
+    }
+    else {
+        divergence_free(velocity.back(), velocity.front(), divergence, gradient_field, pressure_solver); velocity.swap();
+    }
+    auto const t2 = std::chrono::steady_clock::now();
+    if (parameters.measure_divergence)
+        divergence_rms = mac ? divergence_norm(mac_velocity) : divergence_norm(velocity.front());
+    auto const t2_advect = std::chrono::steady_clock::now();
+
+    if (mac) {
+        advect(mac_velocity, dt_cells);
+        // The density is advected using the velocity at the cell centers (average of the two faces along each direction)
+        velocity_at_cell_centers(velocity.front(), mac_velocity);
+    }
+    else if (sparse) {
+        average_velocity(velocity_average, velocity.front(), tiles);
+        advect(velocity.back(), velocity.front(), velocity_average, dt_cells, reflective, tiles); velocity.swap();
+    }
+    else {
+        average_velocity(velocity_average, velocity.front());
+        advect(velocity.back(), velocity.front(), velocity_average, dt_cells, reflective); velocity.swap();
+    }
+    auto const t3 = std::chrono::steady_clock::now();
+
+    // density
+    auto t4 = t3, t5 = t3;
+    if (parameters.advect_density) {
+        if (sparse) {
+            diffuse_red_black(density.back(), density.front(), mu_density, dt, copy, iterations, tiles); density.swap();
+        }
+        else {
+            diffuse_red_black(density.back(), density.front(), mu_density, dt, copy, iterations); density.swap();
+        }
+        t4 = std::chrono::steady_clock::now();
+
+        if (mac) {
+            advect(density.back(), density.front(), velocity.front(), dt_cells, copy); density.swap();
+        }
+        else if (sparse) {
+            average_velocity(velocity_average, velocity.front(), tiles);
+            advect(density.back(), density.front(), velocity_average, dt_cells, copy, tiles); density.swap();
+        }
+        else {
+            average_velocity(velocity_average, velocity.front());
+            advect(density.back(), density.front(), velocity_average, dt_cells, copy); density.swap();
+        }
+        t5 = std::chrono::steady_clock::now();
+    }
 
-}
\ No newline at end of file
+    // The update of the tiles is counted in the total only
+    timing.diffuse = elapsed_ms(t0, t1) + elapsed_ms(t3, t4);
+    timing.project = elapsed_ms(t1, t2);
+    timing.advect = elapsed_ms(t2_advect, t3) + elapsed_ms(t4, t5);
+    timing.total = elapsed_ms(t_start, t5) - elapsed_ms(t2, t2_advect);
+}
@@ -2,14 +2,73 @@
 
 #include "cgp/cgp.hpp"
 #include "boundary.hpp"
+#include "diffusion.hpp"
+#include "multigrid.hpp"
+#include "field_buffer.hpp"
+#include "advection.hpp"
+#include "sparse_tiles.hpp"
+#include "mac_grid.hpp"
 
 
 
 
-void divergence_free(cgp::grid_2D<cgp::vec2>& new_velocity, cgp::grid_2D<cgp::vec2> const& velocity, cgp::grid_2D<float>& divergence, cgp::grid_2D<float>& gradient_field);
+void divergence_free(cgp::grid_2D<cgp::vec2>& new_velocity, cgp::grid_2D<cgp::vec2> const& velocity, cgp::grid_2D<float>& divergence, cgp::grid_2D<float>& gradient_field, multigrid_poisson_structure& poisson_solver);
 
 template <typename T> void diffuse(cgp::grid_2D<T>& new_field, cgp::grid_2D<T> const& field_reference, float mu, float dt, boundary_condition boundary);
-template <typename T> void advect(cgp::grid_2D<T>& new_value, cgp::grid_2D<T> const& value_reference, cgp::grid_2D<cgp::vec2> const& velocity, float dt);
+template <typename T> void advect(cgp::grid_2D<T>& new_value, cgp::grid_2D<T> const& value_reference, cgp::grid_2D<cgp::vec2> const& velocity_average, float dt, boundary_condition boundary);
+
+// Same steps restricted to the active tiles (see sparse_tiles.hpp)
+//  The Poisson equation of the projection is still solved on the entire grid: the pressure is a global quantity.
+void divergence_free(cgp::grid_2D<cgp::vec2>& new_velocity, cgp::grid_2D<cgp::vec2> const& velocity, cgp::grid_2D<float>& divergence, cgp::grid_2D<float>& gradient_field, multigrid_poisson_structure& poisson_solver, sparse_tiles_structure const& tiles);
+template <typename T> void diffuse(cgp::grid_2D<T>& new_field, cgp::grid_2D<T> const& field_reference, float mu, float dt, boundary_condition boundary, sparse_tiles_structure const& tiles);
+template <typename T> void advect(cgp::grid_2D<T>& new_value, cgp::grid_2D<T> const& value_reference, cgp::grid_2D<cgp::vec2> const& velocity_average, float dt, boundary_condition boundary, sparse_tiles_structure const& tiles);
+
+float divergence_norm(cgp::grid_2D<cgp::vec2> const& velocity); // RMS of the divergence computed as in divergence_free (central differences)
+
+
+struct fluid_2D_parameters {
+    float diffusion_velocity = 0.001f;
+    float diffusion_density = 0.005f;
+    int diffusion_iterations = 15;   // Gauss-Seidel sweeps of the diffusion
+    bool advect_density = true;      // If false, the density is not modified by the step (e.g. when it displays the curl of the velocity)
+    bool mac_grid = false;           // Store the velocity on a staggered (MAC) grid instead of the cell centers
+    bool sparse_tiles = false;       // Only simulate the tiles where the fluid is moving (collocated velocity only)
+    bool measure_divergence = false; // Compute the RMS divergence after the projection (not included in the timing)
+};
+
+// Timing of the last call to simulate() (in ms), common to the 2D and 3D fluids
+struct fluid_timing {
+    float diffuse = 0.0f;
+    float project = 0.0f;
+    float advect = 0.0f;
+    float total = 0.0f;
+};
+
+// Complete state of a 2D simulation: velocity and color density, with the temporary buffers of the solver
+//  simulate() is the step run by the scene and measured by the benchmark.
+struct fluid_2D_structure {
+    field_buffer<cgp::vec3> density;  // Front/back buffers: the current field is density.front()
+    field_buffer<cgp::vec2> velocity; // Front/back buffers: the current field is velocity.front()
+    mac_velocity_structure mac_velocity;         // Staggered velocity (used if parameters.mac_grid is set, velocity.front() then stores its value at the cell centers)
+    cgp::grid_2D<float> divergence;
+    cgp::grid_2D<float> gradient_field;
+    cgp::grid_2D<cgp::vec2> velocity_average;    // Velocity averaged around each cell, used for the advection
+    multigrid_poisson_structure pressure_solver; // Poisson solver used in the projection step
+    sparse_tiles_structure tiles;                // Active tiles of the domain (used if parameters.sparse_tiles is set)
+    float cell_size = 1.0f;                      // Size of a cell in world units (the velocity is in world units, the advection back-traces in cells)
+
+    fluid_2D_parameters parameters;
+    fluid_timing timing;
+    float divergence_rms = 0.0f; // RMS divergence of the velocity after the last projection (if parameters.measure_divergence)
+
+    // Allocate the fields for Nx x Ny cells (including the border cells) at rest
+    //  The density is only resized: it is filled afterward (followed by density.resize_back_to_front())
+    void initialize(int Nx, int Ny, float cell_size);
+
+    // One step of the stable fluids: diffusion, projection and advection of the velocity, then diffusion and advection of the density
+    //  The velocity is stored on the staggered grid if parameters.mac_grid is set, otherwise on the cell centers (restricted to the active tiles if parameters.sparse_tiles is set)
+    void simulate(float dt);
+};
 
 
 
@@ -17,56 +76,41 @@ template <typename T> void advect(cgp::grid_2D<T>& new_value, cgp::grid_2D<T> co
 template <typename T>
 void diffuse(cgp::grid_2D<T>& f, cgp::grid_2D<T> const& f_prev, float mu, float dt, boundary_condition boundary)
 {
-    using namespace cgp;
     // Compute diffusion on f
     //  Use f as current value, f_prev as previous value
     //  The function is generic in order to handle f as being either a velocity (T=vec2), or a color density (T=vec3)
-
-    // TO do:
-    //  Update the field f in solving the diffusion equation for the time step dt
-    //  Use Gauss-Seidel iterations over 10 to 15 times
-    //   For each iteration, you may reset the boundary conditions with the following code:
-    //   		if(boundary==copy)
-	//		set_boundary(f);
-	//       	else
-	//		set_boundary_reflective(f);
-    // 
-    //  Note: 
-    //     - The value of f at coordinates x,y is f(x,y)
-    //     - The field are stored as a grid: f.dimension[0], and f.dimension[1] gives the respective size of the grid in x and y coordinates.
-
-
+    //
+    //  The Gauss-Seidel iterations are computed using a red-black ordering (see diffusion.hpp):
+    //   this ordering allows to parallelize each sweep, and the boundary conditions are set within the sweep.
+    int const N_iteration = 15;
+    diffuse_red_black(f, f_prev, mu, dt, boundary, N_iteration);
 }
 
 
 
 template <typename T>
-void advect(cgp::grid_2D<T>& new_value, cgp::grid_2D<T> const& value_reference, cgp::grid_2D<cgp::vec2> const& velocity, float dt)
+void advect(cgp::grid_2D<T>& new_value, cgp::grid_2D<T> const& value_reference, cgp::grid_2D<cgp::vec2> const& velocity_average, float dt, boundary_condition boundary)
 {
-    using namespace cgp;
     // Compute advection of value along the velocity v, given its previous state value_prev
-    int const N = int(new_value.dimension.x);
-	
-	for(int x=1; x<N-1; ++x) {
-        for(int y=1; y<N-1; ++y) {
-            vec2 const p  = {float(x),float(y)};
-
-            // retrieve an averaged velocity value around the position p to avoid grid artifacts
-			vec2 const v = 0.25f*(interpolation_bilinear(velocity, x+0.5f, y+0.5f)+
-				interpolation_bilinear(velocity, x-0.5f, y+0.5f)+
-				interpolation_bilinear(velocity, x+0.5f, y-0.5f)+
-				interpolation_bilinear(velocity, x-0.5f, y-0.5f));
-
-            // Back tracing
-			vec2 const p_back = p-dt*v;
-
-            // Retrieve back-traced value and set it to the new value
-			new_value(x,y) = interpolation_bilinear(value_reference, p_back.x, p_back.y);
-
-        }
-    }
+    //  new_value is entirely written (interior cells, then the boundary condition): it can be a back buffer (see field_buffer.hpp)
+    //
+    //  The velocity is expected to be already averaged around each cell to avoid grid artifacts (see average_velocity in advection.hpp):
+    //   the average is computed once per step instead of 4 bilinear interpolations per cell.
+    //  The back-tracing and the bilinear interpolation are computed by the tiled, vectorized and parallel kernel of advection.hpp
+    //
+    //  The back-tracing is computed in cells: for a velocity in world units, dt is the time step divided by the size of a cell
+    advect_semi_lagrangian(new_value, value_reference, velocity_average, dt, boundary);
 }
 
+template <typename T>
+void diffuse(cgp::grid_2D<T>& f, cgp::grid_2D<T> const& f_prev, float mu, float dt, boundary_condition boundary, sparse_tiles_structure const& tiles)
+{
+    int const N_iteration = 15;
+    diffuse_red_black(f, f_prev, mu, dt, boundary, N_iteration, tiles);
+}
 
-
-
+template <typename T>
+void advect(cgp::grid_2D<T>& new_value, cgp::grid_2D<T> const& value_reference, cgp::grid_2D<cgp::vec2> const& velocity_average, float dt, boundary_condition boundary, sparse_tiles_structure const& tiles)
+{
+    advect_semi_lagrangian(new_value, value_reference, velocity_average, dt, boundary, tiles);
+}
@@ -0,0 +1,127 @@
+#include "simulation_3D.hpp"
+
+#include <chrono>
+
+using namespace cgp;
+
+
+float divergence_norm(grid_3D<vec3> const& velocity)
+{
+    int const Nx = int(velocity.dimension.x);
+    int const Ny = int(velocity.dimension.y);
+    int const Nz = int(velocity.dimension.z);
+    double sum = 0.0;
+    #pragma omp parallel for reduction(+:sum) schedule(static)
+    for (int z = 1; z < Nz - 1; ++z) {
+        for (int y = 1; y < Ny - 1; ++y) {
+            for (int x = 1; x < Nx - 1; ++x) {
+                double const d = 0.5 * (velocity(x + 1, y, z).x - velocity(x - 1, y, z).x + velocity(x, y + 1, z).y - velocity(x, y - 1, z).y + velocity(x, y, z + 1).z - velocity(x, y, z - 1).z);
+                sum += d * d;
+            }
+        }
+    }
+    return float(std::sqrt(sum / (double(Nx - 2) * double(Ny - 2) * double(Nz - 2))));
+}
+
+void divergence_free(grid_3D<vec3>& new_velocity, grid_3D<vec3> const& velocity, grid_3D<float>& divergence, grid_3D<float>& gradient_field, multigrid_poisson_3D_structure& poisson_solver)
+{
+    // Same projection as the 2D case: v = v0 - nabla(q), with Laplacian(q) = div(v0)
+    //  The Poisson equation is solved with the multigrid V-cycle, using the previous gradient_field as initial guess.
+    int const Nx = int(velocity.dimension.x);
+    int const Ny = int(velocity.dimension.y);
+    int const Nz = int(velocity.dimension.z);
+
+    // 1. Divergence of v0
+    #pragma omp parallel for schedule(static)
+    for (int z = 1; z < Nz - 1; ++z)
+        for (int y = 1; y < Ny - 1; ++y)
+            for (int x = 1; x < Nx - 1; ++x)
+                divergence(x, y, z) = 0.5f * (velocity(x + 1, y, z).x - velocity(x - 1, y, z).x + velocity(x, y + 1, z).y - velocity(x, y - 1, z).y + velocity(x, y, z + 1).z - velocity(x, y, z - 1).z);
+
+    // 2. Solve Laplacian(q) = div(v0)
+    poisson_solver.solve(gradient_field, divergence);
+
+    // 3. v = v0 - nabla(q)
+    #pragma omp parallel for schedule(static)
+    for (int z = 1; z < Nz - 1; ++z) {
+        for (int y = 1; y < Ny - 1; ++y) {
+            for (int x = 1; x < Nx - 1; ++x) {
+                vec3 const grad = 0.5f * vec3(gradient_field(x + 1, y, z) - gradient_field(x - 1, y, z), gradient_field(x, y + 1, z) - gradient_field(x, y - 1, z), gradient_field(x, y, z + 1) - gradient_field(x, y, z - 1));
+                new_velocity(x, y, z) = velocity(x, y, z) - grad;
+            }
+        }
+    }
+    set_boundary_reflective(new_velocity);
+}
+
+
+void fluid_3D_structure::initialize(int Nx, int Ny, int Nz)
+{
+    velocity.resize(Nx, Ny, Nz);
+    velocity.front().fill({ 0,0,0 });
+    density.resize(Nx, Ny, Nz);
+    density.front().fill(0.0f);
+    divergence.resize(Nx, Ny, Nz);
+    divergence.fill(0.0f);
+    gradient_field.resize(Nx, Ny, Nz);
+    gradient_field.fill(0.0f);
+    pressure_solver.initialize(gradient_field);
+}
+
+void fluid_3D_structure::add_source(vec3 const& center, float radius, float density_value, vec3 const& velocity_value)
+{
+    grid_3D<vec3>& v = velocity.front();
+    grid_3D<float>& d = density.front();
+    int const Nx = int(v.dimension.x);
+    int const Ny = int(v.dimension.y);
+    int const Nz = int(v.dimension.z);
+
+    int const z_min = std::max(int(center.z - radius), 1), z_max = std::min(int(center.z + radius) + 1, Nz - 1);
+    int const y_min = std::max(int(center.y - radius), 1), y_max = std::min(int(center.y + radius) + 1, Ny - 1);
+    int const x_min = std::max(int(center.x - radius), 1), x_max = std::min(int(center.x + radius) + 1, Nx - 1);
+
+    #pragma omp parallel for schedule(static)
+    for (int z = z_min; z < z_max; ++z) {
+        for (int y = y_min; y < y_max; ++y) {
+            for (int x = x_min; x < x_max; ++x) {
+                if (norm(vec3(float(x), float(y), float(z)) - center) < radius) {
+                    d(x, y, z) = density_value;
+                    v(x, y, z) = velocity_value;
+                }
+            }
+        }
+    }
+}
+
+static float elapsed_ms(std::chrono::steady_clock::time_point const& t0, std::chrono::steady_clock::time_point const& t1)
+{
+    return std::chrono::duration<float, std::milli>(t1 - t0).count();
+}
+
+void fluid_3D_structure::simulate(float dt)
+{
+    // Same sequence as fluid_2D_structure::simulate
+    auto const t0 = std::chrono::steady_clock::now();
+
+    // velocity
+    diffuse(velocity.back(), velocity.front(), parameters.diffusion_velocity, dt, reflective, parameters.diffusion_iterations); velocity.swap();
+    auto const t1 = std::chrono::steady_clock::now();
+    divergence_free(velocity.back(), velocity.front(), divergence, gradient_field, pressure_solver); velocity.swap();
+    auto const t2 = std::chrono::steady_clock::now();
+    if (parameters.measure_divergence)
+        divergence_rms = divergence_norm(velocity.front());
+    auto const t2_advect = std::chrono::steady_clock::now();
+    advect(velocity.back(), velocity.front(), velocity.front(), dt, reflective); velocity.swap();
+    auto const t3 = std::chrono::steady_clock::now();
+
+    // density
+    diffuse(density.back(), density.front(), parameters.diffusion_density, dt, copy, parameters.diffusion_iterations); density.swap();
+    auto const t4 = std::chrono::steady_clock::now();
+    advect(density.back(), density.front(), velocity.front(), dt, copy); density.swap();
+    auto const t5 = std::chrono::steady_clock::now();
+
+    timing.diffuse = elapsed_ms(t0, t1) + elapsed_ms(t3, t4);
+    timing.project = elapsed_ms(t1, t2);
+    timing.advect = elapsed_ms(t2_advect, t3) + elapsed_ms(t4, t5);
+    timing.total = timing.diffuse + timing.project + timing.advect;
+}
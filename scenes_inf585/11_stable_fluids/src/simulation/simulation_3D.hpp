@@ -0,0 +1,135 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+#include "boundary_3D.hpp"
+#include "field_buffer.hpp"
+#include "multigrid.hpp"
+#include "simulation.hpp"
+
+
+// 3D version of the stable fluids solver on cgp::grid_3D
+//  All the steps are parallelized over the z-slabs of the grid (OpenMP). The grids are stored with x as the fastest index.
+
+
+template <typename T> void diffuse(cgp::grid_3D<T>& f, cgp::grid_3D<T> const& f_prev, float mu, float dt, boundary_condition boundary, int iterations = 10);
+template <typename T> void advect(cgp::grid_3D<T>& new_value, cgp::grid_3D<T> const& value_reference, cgp::grid_3D<cgp::vec3> const& velocity, float dt, boundary_condition boundary);
+float divergence_norm(cgp::grid_3D<cgp::vec3> const& velocity); // RMS of the divergence computed as in divergence_free (central differences)
+void divergence_free(cgp::grid_3D<cgp::vec3>& new_velocity, cgp::grid_3D<cgp::vec3> const& velocity, cgp::grid_3D<float>& divergence, cgp::grid_3D<float>& gradient_field, multigrid_poisson_3D_structure& poisson_solver);
+
+template <typename T> void set_boundary_condition(cgp::grid_3D<T>& grid, boundary_condition boundary);
+
+
+struct fluid_3D_parameters {
+    float diffusion_velocity = 0.001f;
+    float diffusion_density = 0.001f;
+    int diffusion_iterations = 10; // Gauss-Seidel sweeps of the diffusion
+    bool measure_divergence = false; // Compute the RMS divergence after the projection (not included in the timing)
+};
+
+// Complete state of a 3D smoke simulation: velocity and scalar density, with the temporary buffers of the projection
+struct fluid_3D_structure {
+    field_buffer_3D<cgp::vec3> velocity;
+    field_buffer_3D<float> density;
+    cgp::grid_3D<float> divergence;
+    cgp::grid_3D<float> gradient_field;
+    multigrid_poisson_3D_structure pressure_solver; // Poisson solver of the projection (tolerance in pressure_solver.parameters)
+
+    fluid_3D_parameters parameters;
+    fluid_timing timing;
+    float divergence_rms = 0.0f; // RMS divergence of the velocity after the last projection (if parameters.measure_divergence)
+
+    // Allocate the fields (including the border cells) at rest, with zero density
+    void initialize(int Nx, int Ny, int Nz);
+
+    // Add density and velocity in a sphere (center and radius in cells)
+    void add_source(cgp::vec3 const& center, float radius, float density_value, cgp::vec3 const& velocity_value);
+
+    // One step of the stable fluids: diffusion, projection and advection of the velocity, then diffusion and advection of the density
+    void simulate(float dt);
+};
+
+
+
+
+template <typename T>
+void set_boundary_condition(cgp::grid_3D<T>& grid, boundary_condition boundary)
+{
+    if (boundary == copy)
+        set_boundary(grid);
+    else
+        set_boundary_reflective(grid);
+}
+
+template <typename T>
+void diffuse(cgp::grid_3D<T>& f, cgp::grid_3D<T> const& f_prev, float mu, float dt, boundary_condition boundary, int iterations)
+{
+    // Solve (Id - dt mu Laplacian) f = f_prev
+    //  - The first sweep is a Jacobi sweep reading f_prev (f_prev is the initial guess, the previous content of f is never read).
+    //  - The next sweeps are red-black Gauss-Seidel: each color is updated in parallel over the z-slabs.
+    using namespace cgp;
+    int const Nx = int(f_prev.dimension.x);
+    int const Ny = int(f_prev.dimension.y);
+    int const Nz = int(f_prev.dimension.z);
+    float const N = float(std::max(Nx, std::max(Ny, Nz)));
+    float const a = dt * mu * N * N;
+    float const inv = 1.0f / (1.0f + 6.0f * a);
+
+    #pragma omp parallel for schedule(static)
+    for (int z = 1; z < Nz - 1; ++z)
+        for (int y = 1; y < Ny - 1; ++y)
+            for (int x = 1; x < Nx - 1; ++x)
+                f(x, y, z) = (f_prev(x, y, z) + a * (f_prev(x - 1, y, z) + f_prev(x + 1, y, z) + f_prev(x, y - 1, z) + f_prev(x, y + 1, z) + f_prev(x, y, z - 1) + f_prev(x, y, z + 1))) * inv;
+    set_boundary_condition(f, boundary);
+
+    for (int k_iteration = 1; k_iteration < iterations; ++k_iteration) {
+        for (int color = 0; color < 2; ++color) {
+            #pragma omp parallel for schedule(static)
+            for (int z = 1; z < Nz - 1; ++z) {
+                for (int y = 1; y < Ny - 1; ++y) {
+                    int const x_start = 1 + ((1 + y + z + color) & 1); // First x such that (x+y+z)%2 == color
+                    for (int x = x_start; x < Nx - 1; x += 2)
+                        f(x, y, z) = (f_prev(x, y, z) + a * (f(x - 1, y, z) + f(x + 1, y, z) + f(x, y - 1, z) + f(x, y + 1, z) + f(x, y, z - 1) + f(x, y, z + 1))) * inv;
+                }
+            }
+            set_boundary_condition(f, boundary);
+        }
+    }
+}
+
+template <typename T>
+void advect(cgp::grid_3D<T>& new_value, cgp::grid_3D<T> const& value_reference, cgp::grid_3D<cgp::vec3> const& velocity, float dt, boundary_condition boundary)
+{
+    // Semi-Lagrangian advection with trilinear interpolation of the back-traced value
+    using namespace cgp;
+    int const Nx = int(value_reference.dimension.x);
+    int const Ny = int(value_reference.dimension.y);
+    int const Nz = int(value_reference.dimension.z);
+
+    #pragma omp parallel for schedule(static)
+    for (int z = 1; z < Nz - 1; ++z) {
+        for (int y = 1; y < Ny - 1; ++y) {
+            for (int x = 1; x < Nx - 1; ++x) {
+                vec3 const v = velocity(x, y, z);
+
+                // Back tracing, clamped to the grid
+                float const px = std::min(std::max(x - dt * v.x, 0.0f), Nx - 1.0f);
+                float const py = std::min(std::max(y - dt * v.y, 0.0f), Ny - 1.0f);
+                float const pz = std::min(std::max(z - dt * v.z, 0.0f), Nz - 1.0f);
+                int const x0 = std::min(int(px), Nx - 2);
+                int const y0 = std::min(int(py), Ny - 2);
+                int const z0 = std::min(int(pz), Nz - 2);
+                float const a = px - x0;
+                float const b = py - y0;
+                float const c = pz - z0;
+
+                // Trilinear interpolation
+                T const v00 = (1 - a) * value_reference(x0, y0, z0) + a * value_reference(x0 + 1, y0, z0);
+                T const v10 = (1 - a) * value_reference(x0, y0 + 1, z0) + a * value_reference(x0 + 1, y0 + 1, z0);
+                T const v01 = (1 - a) * value_reference(x0, y0, z0 + 1) + a * value_reference(x0 + 1, y0, z0 + 1);
+                T const v11 = (1 - a) * value_reference(x0, y0 + 1, z0 + 1) + a * value_reference(x0 + 1, y0 + 1, z0 + 1);
+                new_value(x, y, z) = (1 - c) * ((1 - b) * v00 + b * v10) + c * ((1 - b) * v01 + b * v11);
+            }
+        }
+    }
+    set_boundary_condition(new_value, boundary);
+}
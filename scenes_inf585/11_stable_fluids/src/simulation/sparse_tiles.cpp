@@ -0,0 +1,108 @@
+#include "sparse_tiles.hpp"
+
+using namespace cgp;
+
+
+void sparse_tiles_structure::initialize(int Nx_arg, int Ny_arg)
+{
+    Nx = Nx_arg;
+    Ny = Ny_arg;
+    Tx = std::max((Nx - 2 + tile_size - 1) / tile_size, 0);
+    Ty = std::max((Ny - 2 + tile_size - 1) / tile_size, 0);
+
+    active.assign(Tx * Ty, 0);
+    moving.assign(Tx * Ty, 0);
+    active_tiles.clear();
+    retired_tiles.clear();
+    full_update = true;
+    synchronize = true;
+}
+
+void sparse_tiles_structure::tile_range(int tile, int& x_begin, int& x_end, int& y_begin, int& y_end) const
+{
+    int const tx = tile % Tx;
+    int const ty = tile / Tx;
+    x_begin = 1 + tx * tile_size;
+    y_begin = 1 + ty * tile_size;
+    x_end = std::min(x_begin + tile_size, Nx - 1);
+    y_end = std::min(y_begin + tile_size, Ny - 1);
+}
+
+float sparse_tiles_structure::active_ratio() const
+{
+    if (Tx * Ty == 0)
+        return 0.0f;
+    return float(active_tiles.size()) / float(Tx * Ty);
+}
+
+void sparse_tiles_structure::update(grid_2D<vec2> const& velocity, grid_2D<vec3> const& density)
+{
+    // 1. Tiles to be scanned: the velocity can only be above the threshold, and the density can only vary, in the active tiles
+    //    (the others are at rest, and neither the fluid nor the diffusion can go further than their neighbors in one step)
+    candidates.clear();
+    if (full_update) {
+        for (int k = 0; k < Tx * Ty; ++k)
+            candidates.push_back(k);
+    }
+    else {
+        for (int k = 0; k < Tx * Ty; ++k)
+            moving[k] = 0;
+        for (int tile : active_tiles)
+            candidates.push_back(tile);
+    }
+
+    // 2. Tiles where the fluid is moving, or where the density diffuses
+    float const threshold2 = threshold * threshold;
+    float const density_threshold2 = density_threshold * density_threshold;
+    int const N_candidates = int(candidates.size());
+    #pragma omp parallel for schedule(dynamic, 4)
+    for (int k = 0; k < N_candidates; ++k) {
+        int x_begin, x_end, y_begin, y_end;
+        tile_range(candidates[k], x_begin, x_end, y_begin, y_end);
+
+        char is_moving = 0;
+        for (int y = y_begin; y < y_end && !is_moving; ++y)
+            for (int x = x_begin; x < x_end && !is_moving; ++x)
+                is_moving = (dot(velocity(x, y), velocity(x, y)) > threshold2);
+
+        // Differences between adjacent cells, including the pairs across the sides of the tile
+        if (track_density) {
+            for (int y = y_begin; y < y_end && !is_moving; ++y) {
+                for (int x = x_begin - 1; x < x_end && !is_moving; ++x) {
+                    vec3 const d = density(x + 1, y) - density(x, y);
+                    is_moving = (dot(d, d) > density_threshold2);
+                }
+            }
+            for (int y = y_begin - 1; y < y_end && !is_moving; ++y) {
+                for (int x = x_begin; x < x_end && !is_moving; ++x) {
+                    vec3 const d = density(x, y + 1) - density(x, y);
+                    is_moving = (dot(d, d) > density_threshold2);
+                }
+            }
+        }
+        moving[candidates[k]] = is_moving;
+    }
+
+    // 3. Active tiles = moving tiles dilated by one tile
+    retired_tiles.clear();
+    active_tiles.clear();
+    for (int ty = 0; ty < Ty; ++ty) {
+        for (int tx = 0; tx < Tx; ++tx) {
+            char is_active = 0;
+            for (int dy = -1; dy <= 1 && !is_active; ++dy)
+                for (int dx = -1; dx <= 1 && !is_active; ++dx)
+                    if (tx + dx >= 0 && tx + dx < Tx && ty + dy >= 0 && ty + dy < Ty)
+                        is_active = moving[(tx + dx) + Tx * (ty + dy)];
+
+            int const tile = tx + Tx * ty;
+            if (is_active)
+                active_tiles.push_back(tile);
+            else if (active[tile] || synchronize)
+                retired_tiles.push_back(tile);
+            active[tile] = is_active;
+        }
+    }
+
+    full_update = false;
+    synchronize = false;
+}
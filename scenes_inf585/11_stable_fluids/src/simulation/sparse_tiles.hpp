@@ -0,0 +1,83 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+#include "field_buffer.hpp"
+
+
+// Sparse representation of the simulation domain as tiles of tile_size x tile_size interior cells
+//  - A tile is moving if the velocity of one of its cells is above the threshold, or, when the density diffuses (track_density),
+//    if its density is not uniform (difference between two adjacent cells above density_threshold): a density blob in still fluid
+//    keeps spreading as in the dense solver. A uniform density (e.g. the white background) doesn't change and is left at rest.
+//  - A tile is active if it is moving or if one of its 8 neighboring tiles is moving:
+//    the fluid can then move into the neighboring tiles within one step (as long as it moves less than tile_size cells per step).
+//  - The steps of the solver (diffuse, divergence_free, advect) only process the active tiles.
+//  - The inactive tiles are at rest: their velocity is 0, and their density is the same in the front and back buffers (see retire_tiles).
+//    They are therefore valid in whichever buffer is read, and they don't need to be written.
+struct sparse_tiles_structure {
+
+    static int const tile_size = 16;
+    float threshold = 3e-6f;          // Velocity norm (world units) below which a cell is considered at rest
+    float density_threshold = 1e-3f;  // Density difference between adjacent cells below which the density is considered uniform
+    bool track_density = true;        // If true, the tiles with a non-uniform density are active (set it when the density diffuses)
+
+    int Nx = 0, Ny = 0;       // Dimension of the grid (including the border cells)
+    int Tx = 0, Ty = 0;       // Number of tiles along each direction
+
+    std::vector<char> active;         // Activity of each tile (index tx + Tx*ty)
+    std::vector<int> active_tiles;    // List of the active tiles
+    std::vector<int> retired_tiles;   // Tiles that became inactive during the last update()
+    bool full_update = true;          // If true, the next update() considers all the tiles (and not only the neighborhood of the active ones)
+
+    // Set all the tiles as inactive for a grid of size Nx x Ny
+    //  The next update() scans the entire grid, and retires all the inactive tiles (the buffers of the fields are then synchronized)
+    void initialize(int Nx, int Ny);
+
+    // Update the set of active tiles from the current velocity and density
+    //  Only the active tiles and their neighbors are scanned, unless full_update is set (e.g. after an external modification of the velocity)
+    void update(cgp::grid_2D<cgp::vec2> const& velocity, cgp::grid_2D<cgp::vec3> const& density);
+
+    // Interior cells [x_begin,x_end[ x [y_begin,y_end[ covered by a tile
+    void tile_range(int tile, int& x_begin, int& x_end, int& y_begin, int& y_end) const;
+
+    // Ratio of active tiles in the domain
+    float active_ratio() const;
+
+private:
+    std::vector<char> moving;      // Tiles containing a velocity above the threshold (or a non-uniform density)
+    std::vector<int> candidates;   // Tiles scanned by update()
+    bool synchronize = true;       // If true, the next update() retires all the inactive tiles
+};
+
+
+// Put the tiles retired by the last update (and their adjacent border cells) at rest in both buffers of a field
+//  The velocity is set to zero, other fields are copied from the front to the back buffer
+template <typename T> void retire_tiles(field_buffer<T>& field, sparse_tiles_structure const& tiles, bool set_to_zero);
+
+
+
+
+template <typename T>
+void retire_tiles(field_buffer<T>& field, sparse_tiles_structure const& tiles, bool set_to_zero)
+{
+    int const N_retired = int(tiles.retired_tiles.size());
+
+    #pragma omp parallel for schedule(static)
+    for (int k = 0; k < N_retired; ++k) {
+        int x_begin, x_end, y_begin, y_end;
+        tiles.tile_range(tiles.retired_tiles[k], x_begin, x_end, y_begin, y_end);
+
+        // Include the border cells of the grid adjacent to the tile
+        x_begin = (x_begin == 1) ? 0 : x_begin;
+        y_begin = (y_begin == 1) ? 0 : y_begin;
+        x_end = (x_end == tiles.Nx - 1) ? tiles.Nx : x_end;
+        y_end = (y_end == tiles.Ny - 1) ? tiles.Ny : y_end;
+
+        for (int y = y_begin; y < y_end; ++y) {
+            for (int x = x_begin; x < x_end; ++x) {
+                if (set_to_zero)
+                    field.front()(x, y) = T();
+                field.back()(x, y) = field.front()(x, y);
+            }
+        }
+    }
+}